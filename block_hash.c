@@ -1,20 +1,387 @@
-/* libjodycode: wrapper stub for jody_hash
+/* libjodycode: hash backend registry and jody_hash wrappers
  *
  * Copyright (C) 2023-2024 by Jody Bruchon <jody@jodybruchon.com>
  * Released under The MIT License
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include "libjodycode.h"
+#include "crc32c.h"
 #include "jody_hash.h"
+#include "likely_unlikely.h"
+
+#if defined _WIN32 || defined __WIN32 || defined ON_WINDOWS
+ #ifndef NO_THREADS
+  #define NO_THREADS
+ #endif
+#endif
+#ifndef NO_THREADS
+ #include <pthread.h>
+#endif
+
+/* jc_set_hash_kernel() passes enum jc_e_hash_kernel values straight
+ * through as jody_hash kernel IDs */
+_Static_assert(HASH_KERNEL_AUTO == JH_KERNEL_AUTO && HASH_KERNEL_SCALAR == JH_KERNEL_SCALAR
+		&& HASH_KERNEL_SSE2 == JH_KERNEL_SSE2 && HASH_KERNEL_AVX2 == JH_KERNEL_AVX2
+		&& HASH_KERNEL_AVX512 == JH_KERNEL_AVX512, "enum jc_e_hash_kernel and JH_KERNEL_* differ");
+_Static_assert(HASH_KERNEL_AVX512 + 1 == JH_KERNEL_COUNT, "JH_KERNEL_* has kernels jc_e_hash_kernel lacks");
+
+/* Automatic prefetch distance is L2 size / JC_PF_L2_DIVISOR within limits */
+#define JC_PF_L2_DIVISOR 512
+#define JC_PF_MIN_DISTANCE 1024
+#define JC_PF_MAX_DISTANCE 16384
+
+/* Prefetching is tuned for this machine the first time anything is hashed */
+#ifdef NO_THREADS
+static int prefetch_tuned = 0;
+#else
+static pthread_once_t prefetch_once = PTHREAD_ONCE_INIT;
+#endif
+
+static int prefetch_set(size_t distance, size_t threshold);
+
+/* Hash backends in enum jc_e_hash order. Each one picks its own SIMD code
+ * at runtime; width is the number of result bits stored at *hash. */
+struct jc_hash_backend {
+	const char *name;
+	int (*block_hash)(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+	int width;
+};
+
+static const struct jc_hash_backend jc_hash_backends[JC_HASH_TYPES] = {
+	{ "normal",     jody_block_hash,            64 },
+	{ "rolling",    jody_rolling_block_hash,    64 },
+	{ "striped",    jody_striped_block_hash,    64 },
+	{ "rolling_mt", jody_rolling_block_hash_mt, 64 },
+	{ "normal128",  jody_block_hash128,         128 },
+	{ "crc32c",     crc32c_block_hash,          32 },
+	{ "seeded",     jody_seeded_block_hash,     64 },
+};
+
+
+static void prefetch_tune(void)
+{
+	prefetch_set(0, 0);
+	return;
+}
+
+
+/* Tune prefetching once; every hashing entry point calls this first */
+extern void jc_hash_prefetch_init(void)
+{
+#ifdef NO_THREADS
+	if (unlikely(prefetch_tuned == 0)) {
+		prefetch_tuned = 1;
+		prefetch_tune();
+	}
+#else
+	pthread_once(&prefetch_once, prefetch_tune);
+#endif
+	return;
+}
+
 
 extern int jc_block_hash(enum jc_e_hash type, jodyhash_t *data, jodyhash_t *hash, const size_t count)
 {
-	switch (type) {
-	default:
-	case NORMAL:
-		return jody_block_hash(data, hash, count);
-	case ROLLING:
-		return jody_rolling_block_hash(data, hash, count);
+	jc_hash_prefetch_init();
+	/* Unknown types have always been treated as NORMAL */
+	if (unlikely((unsigned int)type >= JC_HASH_TYPES)) type = NORMAL;
+	return jc_hash_backends[type].block_hash(data, hash, count);
+}
+
+
+/* NORMAL and 4K ROLLING without the backend lookup, for callers that
+ * know the type at compile time (the C++ wrappers) */
+extern int jc_block_hash_normal(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	jc_hash_prefetch_init();
+	if (jody_block_hash(data, hash, count) != 0) {
+		jc_errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+
+extern int jc_block_hash_rolling(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	jc_hash_prefetch_init();
+	if (jody_rolling_block_hash(data, hash, count) != 0) {
+		jc_errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Look up a hash type by name; returns -1 if there is no such hash */
+extern int jc_get_hash_type(const char * const name)
+{
+	if (unlikely(name == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	for (int i = 0; i < JC_HASH_TYPES; i++)
+		if (strcmp(name, jc_hash_backends[i].name) == 0) return i;
+	jc_errno = EINVAL;
+	return -1;
+}
+
+
+extern const char *jc_get_hash_name(const enum jc_e_hash type)
+{
+	if ((unsigned int)type >= JC_HASH_TYPES) return NULL;
+	return jc_hash_backends[type].name;
+}
+
+
+/* Number of result bits a hash type stores at *hash, or -1 if invalid */
+extern int jc_get_hash_width(const enum jc_e_hash type)
+{
+	if ((unsigned int)type >= JC_HASH_TYPES) return -1;
+	return jc_hash_backends[type].width;
+}
+
+
+/* Hash many independent buffers in one call. NORMAL and small ROLLING
+ * buffers are interleaved across SIMD lanes, one buffer per lane, which
+ * is much faster than separate calls for lots of small buffers. */
+extern int jc_block_hash_multi(enum jc_e_hash type, struct jc_hash_job *jobs, const size_t cnt)
+{
+	jodyhash_t *data[JH_MULTI_BATCH];
+	jodyhash_t hash[JH_MULTI_BATCH];
+	size_t count[JH_MULTI_BATCH];
+	size_t i, j, batch;
+	int retval;
+
+	if (unlikely(jobs == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	/* struct jc_hash_job only has room for a 64-bit hash */
+	if (unlikely(type == NORMAL128)) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < cnt; i += batch) {
+		batch = cnt - i;
+		if (batch > JH_MULTI_BATCH) batch = JH_MULTI_BATCH;
+		if (type != NORMAL && type != ROLLING) {
+			for (j = 0; j < batch; j++)
+				if (jc_block_hash(type, jobs[i + j].data, &(jobs[i + j].hash), jobs[i + j].count) != 0) goto error_hash;
+			continue;
+		}
+		for (j = 0; j < batch; j++) {
+			data[j] = jobs[i + j].data;
+			hash[j] = jobs[i + j].hash;
+			count[j] = jobs[i + j].count;
+		}
+		if (type == NORMAL) retval = jody_block_hash_multi(data, hash, count, batch);
+		else retval = jody_rolling_block_hash_multi(data, hash, count, batch);
+		if (retval != 0) goto error_hash;
+		for (j = 0; j < batch; j++) jobs[i + j].hash = hash[j];
+	}
+	return 0;
+
+error_hash:
+	jc_errno = EIO;
+	return -1;
+}
+
+
+/* NORMAL hashes of two buffers plus a byte compare in a single pass, for
+ * confirming duplicates without reading the data twice. *hash1 and *hash2
+ * chain like jc_block_hash(). Returns 0 if the buffers match or 1 if they
+ * differ; *mismatch is the offset of the first difference (count if none). */
+extern int jc_block_hash_cmp(jodyhash_t *data1, jodyhash_t *data2, jodyhash_t *hash1, jodyhash_t *hash2, const size_t count, size_t *mismatch)
+{
+	jodyhash_t hash[2];
+
+	if (unlikely(hash1 == NULL || hash2 == NULL || mismatch == NULL || ((data1 == NULL || data2 == NULL) && count > 0))) {
+		jc_errno = JC_ENULL;
+		return -1;
 	}
+	jc_hash_prefetch_init();
+	hash[0] = *hash1;
+	hash[1] = *hash2;
+	if (jody_block_hash_cmp(data1, data2, hash, count, mismatch) != 0) {
+		jc_errno = EIO;
+		return -1;
+	}
+	*hash1 = hash[0];
+	*hash2 = hash[1];
+	return *mismatch != count;
+}
+
+
+/* ROLLING or ROLLING_MT with a block size other than the default 4K; any
+ * power of two from sizeof(jodyhash_t) up is accepted, and 4K, 16K, 64K
+ * and 1M have their own fast paths */
+extern int jc_rolling_block_hash(enum jc_e_hash type, jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t block_size)
+{
+	int retval;
+
+	if (unlikely(hash == NULL || (data == NULL && count > 0))) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (unlikely((type != ROLLING && type != ROLLING_MT) || !JH_ROLL_BSIZE_VALID(block_size))) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	jc_hash_prefetch_init();
+	if (type == ROLLING_MT) retval = jody_rolling_block_hash_mt_bs(data, hash, count, block_size);
+	else retval = jody_rolling_block_hash_bs(data, hash, count, block_size);
+	if (retval != 0) {
+		jc_errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Tune large buffer prefetching. Buffers of at least threshold bytes are
+ * hashed with low-locality prefetches distance bytes ahead of the loads.
+ * Zero for either picks a value from the CPU cache sizes: the distance
+ * scales with L2 and the threshold is the last level cache size, since
+ * anything bigger can't stay cached anyway. A threshold of SIZE_MAX
+ * disables prefetch. */
+extern int jc_set_hash_prefetch(size_t distance, size_t threshold)
+{
+	/* Tune first so the automatic values never replace these later */
+	jc_hash_prefetch_init();
+	return prefetch_set(distance, threshold);
+}
+
+
+static int prefetch_set(size_t distance, size_t threshold)
+{
+#ifdef __linux__
+	struct jc_proc_cacheinfo pci;
+	size_t l2, llc;
+
+	if (distance == 0 || threshold == 0) {
+		jc_get_proc_cacheinfo(&pci);
+		l2 = pci.l2 != 0 ? pci.l2 : pci.l2d;
+		llc = pci.l3 != 0 ? pci.l3 : (pci.l3d != 0 ? pci.l3d : l2);
+		if (distance == 0) {
+			distance = l2 / JC_PF_L2_DIVISOR;
+			if (distance < JC_PF_MIN_DISTANCE) distance = JC_PF_MIN_DISTANCE;
+			if (distance > JC_PF_MAX_DISTANCE) distance = JC_PF_MAX_DISTANCE;
+		}
+		if (threshold == 0) threshold = llc;
+	}
+#endif /* __linux__ */
+	if (distance == 0) distance = JH_PF_DISTANCE;
+	if (threshold == 0) threshold = JH_PF_THRESHOLD;
+	if (jody_hash_set_prefetch(distance, threshold) != 0) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Tree hash: the NORMAL hash of every ROLLBSIZE block (leaves) and a
+ * Merkle root over them. leaves must have room for jc_tree_leaf_count()
+ * hashes or be NULL if only the root is wanted. Large buffers are split
+ * between threads like ROLLING_MT (see jc_set_hash_threads). */
+extern size_t jc_tree_leaf_count(const size_t count)
+{
+	return JH_TREE_LEAVES(count);
+}
+
+
+extern int jc_tree_hash(jodyhash_t *data, const size_t count, jodyhash_t *leaves, jodyhash_t *root)
+{
+	jodyhash_t *buf = leaves;
+	const size_t n = JH_TREE_LEAVES(count);
+	int retval = 0;
+
+	if (unlikely(root == NULL || (data == NULL && count > 0))) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (buf == NULL && n > 0) {
+		buf = (jodyhash_t *)malloc(n * sizeof(jodyhash_t));
+		if (buf == NULL) {
+			jc_errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	if (jody_tree_leaves_mt(data, count, buf) != 0) {
+		jc_errno = EIO;
+		retval = -1;
+	} else *root = jody_tree_root(buf, n);
+
+	if (leaves == NULL) free(buf);
+	return retval;
+}
+
+
+/* Merkle root of existing leaf hashes, e.g. after updating a few leaves */
+extern int jc_tree_root(const jodyhash_t *leaves, const size_t n, jodyhash_t *root)
+{
+	if (unlikely(root == NULL || (leaves == NULL && n > 0))) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	*root = jody_tree_root(leaves, n);
+	return 0;
+}
+
+
+/* Join two subtree roots; subtrees are aligned power-of-two runs of leaves */
+extern jodyhash_t jc_tree_combine(const jodyhash_t left, const jodyhash_t right)
+{
+	return jody_tree_combine(left, right);
+}
+
+
+/* Key for SEEDED hashes; a random key is used if this is never called.
+ * Set it before hashing anything, as earlier SEEDED hashes won't match. */
+extern int jc_set_hash_seed(const uint64_t seed)
+{
+	jody_hash_set_seed(seed);
+	return 0;
+}
+
+
+/* Threads used by ROLLING_MT; 0 = one per online CPU (the default) */
+extern int jc_set_hash_threads(const int threads)
+{
+	if (jody_hash_set_threads(threads) != 0) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Force a specific SIMD kernel; fails if the CPU or build lacks it */
+extern int jc_set_hash_kernel(const enum jc_e_hash_kernel kernel)
+{
+	if (jody_hash_set_kernel((int)kernel) != 0) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+
+extern enum jc_e_hash_kernel jc_get_hash_kernel(void)
+{
+	return (enum jc_e_hash_kernel)jody_hash_get_kernel();
+}
+
+
+extern const char *jc_get_hash_kernel_name(const enum jc_e_hash_kernel kernel)
+{
+	return jody_hash_kernel_name((int)kernel);
 }
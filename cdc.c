@@ -0,0 +1,227 @@
+/* libjodycode: content-defined chunking
+ *
+ * Chunk boundaries come from the data itself using a gear hash
+ * (h = (h << 1) + gear[byte]), so inserting or removing bytes only
+ * changes the chunks around the edit and everything after it still
+ * dedupes. Like FastCDC, a harder mask is used before the average size
+ * and an easier one after it to keep chunk sizes close to the average.
+ *
+ * Every bit of the gear hash depends only on the last 64 bytes, so a
+ * boundary never depends on where hashing started. That lets most of
+ * the minimum chunk size be skipped without hashing and the boundary
+ * scan be split into independent lanes.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "libjodycode.h"
+#include "likely_unlikely.h"
+
+/* Bytes that affect the gear hash */
+#define JC_CDC_WINDOW 64
+/* Default average chunk size and the allowed range of averages */
+#define JC_CDC_AVG 8192
+#define JC_CDC_MIN_AVG 256
+#define JC_CDC_MAX_AVG 1073741824
+/* The boundary scan runs four lanes over segments of this size */
+#define JC_CDC_LANES 4
+#define JC_CDC_SEGMENT 1024
+
+/* Gear table; it is fixed because changing it moves every boundary */
+static uint64_t cdc_gear[256];
+static int cdc_ready = 0;
+
+
+#if defined __GNUC__ || defined __clang__
+__attribute__((constructor))
+#endif
+static void cdc_init(void)
+{
+	uint64_t x = 0, z;
+
+	/* splitmix64 sequence */
+	for (int i = 0; i < 256; i++) {
+		x += 0x9e3779b97f4a7c15ULL;
+		z = x;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		cdc_gear[i] = z ^ (z >> 31);
+	}
+	cdc_ready = 1;
+	return;
+}
+
+
+/* Roll the gear hash over len bytes and return the length up to and
+ * including the first byte where (h & mask) == 0, or 0 if none match */
+static size_t cdc_find_serial(const unsigned char *data, const size_t len, uint64_t *hash, const uint64_t mask)
+{
+	uint64_t h = *hash;
+
+	for (size_t i = 0; i < len; i++) {
+		h = (h << 1) + cdc_gear[data[i]];
+		if (unlikely((h & mask) == 0)) {
+			*hash = h;
+			return i + 1;
+		}
+	}
+	*hash = h;
+	return 0;
+}
+
+
+/* Same as cdc_find_serial() but long scans are split into four segments
+ * hashed side by side, which hides the latency of the serial gear hash.
+ * Lane 0 continues the running hash; the others start from the
+ * JC_CDC_WINDOW bytes before their segment. */
+static size_t cdc_find(const unsigned char *data, const size_t len, uint64_t *hash, const uint64_t mask)
+{
+	const unsigned char *p;
+	uint64_t h[JC_CDC_LANES];
+	uint64_t h0, h1, h2, h3;
+	size_t done, found, rest, t;
+	int j;
+
+	for (done = 0; len - done >= JC_CDC_LANES * JC_CDC_SEGMENT; done += JC_CDC_LANES * JC_CDC_SEGMENT) {
+		p = data + done;
+		h[0] = *hash;
+		for (j = 1; j < JC_CDC_LANES; j++) {
+			h[j] = 0;
+			for (size_t i = (size_t)j * JC_CDC_SEGMENT - JC_CDC_WINDOW; i < (size_t)j * JC_CDC_SEGMENT; i++)
+				h[j] = (h[j] << 1) + cdc_gear[p[i]];
+		}
+
+		h0 = h[0]; h1 = h[1]; h2 = h[2]; h3 = h[3];
+		for (t = 0; t < JC_CDC_SEGMENT; t++) {
+			h0 = (h0 << 1) + cdc_gear[p[t]];
+			h1 = (h1 << 1) + cdc_gear[p[t + JC_CDC_SEGMENT]];
+			h2 = (h2 << 1) + cdc_gear[p[t + (2 * JC_CDC_SEGMENT)]];
+			h3 = (h3 << 1) + cdc_gear[p[t + (3 * JC_CDC_SEGMENT)]];
+			if (unlikely(((h0 & mask) == 0) | ((h1 & mask) == 0) | ((h2 & mask) == 0) | ((h3 & mask) == 0))) break;
+		}
+		h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3;
+		if (likely(t == JC_CDC_SEGMENT)) {
+			*hash = h3;
+			continue;
+		}
+
+		/* Lanes before the first hit may still match later in their segments */
+		for (j = 0; j < JC_CDC_LANES; j++) {
+			found = (size_t)j * JC_CDC_SEGMENT + t + 1;
+			*hash = h[j];
+			if ((h[j] & mask) == 0) return done + found;
+			rest = cdc_find_serial(p + found, JC_CDC_SEGMENT - t - 1, hash, mask);
+			if (rest != 0) return done + found + rest;
+		}
+	}
+
+	found = cdc_find_serial(data + done, len - done, hash, mask);
+	return found != 0 ? done + found : 0;
+}
+
+
+/* min, avg and max chunk sizes; avg must be a power of two. Zero picks
+ * 8 KiB for avg, avg / 4 for min and avg * 8 for max. */
+extern int jc_cdc_init(struct jc_cdc * const restrict cdc, size_t min, size_t avg, size_t max)
+{
+	int bits = 0;
+
+	if (unlikely(cdc == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (avg == 0) avg = JC_CDC_AVG;
+	if (min == 0) min = avg / 4;
+	if (max == 0) max = avg * 8;
+	if (avg < JC_CDC_MIN_AVG || avg > JC_CDC_MAX_AVG || (avg & (avg - 1)) != 0
+			|| min < JC_CDC_WINDOW || min > avg || max < avg) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	if (unlikely(cdc_ready == 0)) cdc_init();
+
+	while (((size_t)1 << bits) < avg) bits++;
+	memset(cdc, 0, sizeof(struct jc_cdc));
+	cdc->min = min;
+	cdc->avg = avg;
+	cdc->max = max;
+	/* Normalized chunking: two more mask bits before avg, two fewer after */
+	cdc->mask_s = ~0ULL << (64 - (bits + 2));
+	cdc->mask_l = ~0ULL << (64 - (bits - 2));
+	return jc_hash_init(&(cdc->hash), NORMAL);
+}
+
+
+/* Finish the current chunk */
+static int cdc_emit(struct jc_cdc * const restrict cdc, struct jc_cdc_chunk * const restrict chunk)
+{
+	chunk->offset = cdc->offset;
+	chunk->length = cdc->len;
+	if (jc_hash_final(&(cdc->hash), &(chunk->hash)) != 0) return -1;
+	cdc->offset += cdc->len;
+	cdc->len = 0;
+	if (jc_hash_init(&(cdc->hash), NORMAL) != 0) return -1;
+	return 1;
+}
+
+
+/* Feed data, stopping at the first chunk boundary. *used is the number
+ * of bytes taken; call again with the rest. Returns 1 if a chunk was
+ * finished and stored in *chunk, 0 if all data went into the current
+ * chunk, or -1 on error. */
+extern int jc_cdc_update(struct jc_cdc * const restrict cdc, const void *data, const size_t len, size_t *used, struct jc_cdc_chunk * const restrict chunk)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t n = len, done = 0, pos, k, found = 0;
+
+	if (unlikely(cdc == NULL || used == NULL || chunk == NULL || (data == NULL && len > 0))) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+
+	/* Never go past the maximum chunk size */
+	if (n > cdc->max - cdc->len) n = cdc->max - cdc->len;
+
+	/* Only the last JC_CDC_WINDOW bytes before min matter */
+	pos = cdc->len;
+	if (pos < cdc->min - JC_CDC_WINDOW) {
+		done = cdc->min - JC_CDC_WINDOW - pos;
+		if (done > n) done = n;
+	}
+	for (; done < n && pos + done < cdc->min; done++) cdc->gear = (cdc->gear << 1) + cdc_gear[p[done]];
+
+	/* Harder mask before avg, easier mask after it */
+	if (done < n && pos + done < cdc->avg) {
+		k = cdc->avg - (pos + done);
+		if (k > n - done) k = n - done;
+		found = cdc_find(p + done, k, &(cdc->gear), cdc->mask_s);
+		done += found != 0 ? found : k;
+	}
+	if (found == 0 && done < n) {
+		found = cdc_find(p + done, n - done, &(cdc->gear), cdc->mask_l);
+		done += found != 0 ? found : n - done;
+	}
+
+	if (done > 0 && jc_hash_update(&(cdc->hash), p, done) != 0) return -1;
+	cdc->len += done;
+	*used = done;
+	if (found == 0 && cdc->len < cdc->max) return 0;
+	return cdc_emit(cdc, chunk);
+}
+
+
+/* Emit whatever is left as the last chunk; returns 1 if there was a
+ * chunk, 0 if there was no data left, or -1 on error */
+extern int jc_cdc_final(struct jc_cdc * const restrict cdc, struct jc_cdc_chunk * const restrict chunk)
+{
+	if (unlikely(cdc == NULL || chunk == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (cdc->len == 0) return 0;
+	return cdc_emit(cdc, chunk);
+}
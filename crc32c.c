@@ -0,0 +1,101 @@
+/* libjodycode: CRC-32C (Castagnoli) hash backend
+ *
+ * A standard CRC-32C in the low 32 bits of a jodyhash_t. Blocks chain
+ * like jody_hash: start with a hash of zero and pass the previous result
+ * in for the next block. Unlike jody_hash, any block size can be chained.
+ * The SSE4.2 CRC32 instruction is used when the CPU has it.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "crc32c.h"
+#include "jody_hash.h"
+#include "likely_unlikely.h"
+
+/* Slicing-by-8 tables for the portable version */
+static uint32_t crc32c_table[8][256];
+static int crc32c_ready = 0;
+#ifndef NO_SSE42
+/* Does the CPU have the SSE4.2 CRC32 instruction? */
+static int crc32c_hw = 0;
+#endif
+
+
+static uint32_t crc32c_scalar(uint32_t crc, const unsigned char *data, size_t count)
+{
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t word;
+
+	for (; count >= 8; count -= 8) {
+		memcpy(&word, data, 8);
+		word ^= crc;
+		crc = crc32c_table[7][word & 0xff] ^
+		      crc32c_table[6][(word >> 8) & 0xff] ^
+		      crc32c_table[5][(word >> 16) & 0xff] ^
+		      crc32c_table[4][(word >> 24) & 0xff] ^
+		      crc32c_table[3][(word >> 32) & 0xff] ^
+		      crc32c_table[2][(word >> 40) & 0xff] ^
+		      crc32c_table[1][(word >> 48) & 0xff] ^
+		      crc32c_table[0][word >> 56];
+		data += 8;
+	}
+#endif
+	for (; count > 0; count--) {
+		crc = crc32c_table[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+		data++;
+	}
+	return crc;
+}
+
+
+/* Build the tables and check for SSE4.2 */
+#if defined __GNUC__ || defined __clang__
+__attribute__((constructor))
+#endif
+static void crc32c_init(void)
+{
+	uint32_t crc;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		crc = i;
+		for (int j = 0; j < 8; j++) crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+		crc32c_table[0][i] = crc;
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (int j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+
+#if !defined NO_SSE42 && (defined __GNUC__ || defined __clang__)
+	__builtin_cpu_init ();
+	crc32c_hw = __builtin_cpu_supports ("sse4.2");
+#endif
+	crc32c_ready = 1;
+	return;
+}
+
+
+/* Hash a block; hash is the CRC of all previous blocks (zero to start).
+ * Forcing the scalar jody_hash kernel also forces the portable CRC code. */
+extern int crc32c_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	uint32_t crc;
+
+	if (unlikely(crc32c_ready == 0)) crc32c_init();
+	crc = ~(uint32_t)*hash;
+#ifndef NO_SSE42
+	if (crc32c_hw && jody_hash_get_kernel() != JH_KERNEL_SCALAR)
+		crc = crc32c_sse42(crc, (const unsigned char *)data, count);
+	else crc = crc32c_scalar(crc, (const unsigned char *)data, count);
+#else
+	crc = crc32c_scalar(crc, (const unsigned char *)data, count);
+#endif
+	*hash = (jodyhash_t)~crc;
+	return 0;
+}
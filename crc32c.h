@@ -0,0 +1,34 @@
+/* libjodycode: CRC-32C (Castagnoli) hash backend (headers)
+ * See crc32c.c for license information */
+
+#ifndef JC_CRC32C_H
+#define JC_CRC32C_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jody_hash.h"
+
+/* Hardware CRC32 instructions are only used on 64-bit x86 */
+#if !defined __x86_64__ || defined NO_SIMD
+ #ifndef NO_SSE42
+  #define NO_SSE42
+ #endif
+#endif
+
+/* Reflected CRC-32C polynomial */
+#define CRC32C_POLY 0x82f63b78U
+
+extern int crc32c_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+#ifndef NO_SSE42
+extern uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t count);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JC_CRC32C_H */
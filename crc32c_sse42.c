@@ -0,0 +1,34 @@
+/* libjodycode: CRC-32C using the SSE4.2 CRC32 instruction
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "crc32c.h"
+
+#ifndef NO_SSE42
+#include <nmmintrin.h>
+
+/* crc is the raw (inverted) CRC register; no pre/post inversion here */
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t count)
+{
+	uint64_t crc64 = crc;
+	uint64_t word;
+
+	/* Eight bytes per instruction; unaligned loads are fine on x86 */
+	for (; count >= 8; count -= 8) {
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		data += 8;
+	}
+	crc = (uint32_t)crc64;
+	for (; count > 0; count--) {
+		crc = _mm_crc32_u8(crc, *data);
+		data++;
+	}
+	return crc;
+}
+
+#endif /* NO_SSE42 */
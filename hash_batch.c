@@ -0,0 +1,436 @@
+/* libjodycode: batch file hashing
+ *
+ * jc_hash_batch() hashes every file named in a jc_fileinfo_batch. On
+ * Linux the opens, reads and closes go through io_uring with up to depth
+ * files in flight, so hashing lots of small files is no longer bound by
+ * one open/read/close round trip after another. io_uring is used through
+ * raw system calls; when it is missing or disabled, the files are hashed
+ * one at a time with jc_hash_file() instead.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libjodycode.h"
+#include "likely_unlikely.h"
+
+#ifndef ON_WINDOWS
+
+#if defined __linux__ && !defined NO_IO_URING && defined __has_include
+ #if __has_include(<linux/io_uring.h>)
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <sys/uio.h>
+  #include <unistd.h>
+  #include <linux/io_uring.h>
+  #if defined __NR_io_uring_setup && defined __NR_io_uring_enter && defined __NR_io_uring_register
+   #define JC_IO_URING
+  #endif
+ #endif
+#endif
+
+/* Default and largest number of files in flight */
+#define JC_HASH_BATCH_DEPTH 32
+#define JC_HASH_BATCH_MAX_DEPTH 256
+/* Read buffer per file in flight; most small files fit in one read */
+#ifndef JC_HASH_BATCH_BUFSIZE
+ #define JC_HASH_BATCH_BUFSIZE 131072
+#endif
+
+
+/* jody_hash words per file in the hashes array */
+static size_t hash_stride(const enum jc_e_hash type)
+{
+	return type == NORMAL128 ? 2 : 1;
+}
+
+
+/* One file at a time with jc_hash_file() */
+static void hash_batch_serial(struct jc_fileinfo_batch * const restrict batch, const enum jc_e_hash type, jodyhash_t *hashes, const uint64_t limit)
+{
+	const size_t stride = hash_stride(type);
+
+	for (int i = 0; i < batch->count; i++) {
+		if (jc_hash_file(batch->files[i].dirent->d_name, type, hashes + ((size_t)i * stride), limit, JC_HASH_IO_AUTO) == 0)
+			batch->files[i].status = 0;
+		else batch->files[i].status = jc_errno;
+	}
+	return;
+}
+
+
+#ifdef JC_IO_URING
+struct uring {
+	int fd;
+	unsigned int pending;   /* queued SQEs not yet submitted */
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+};
+
+/* Each slot works through one file: open, read until done, close */
+enum slot_state { SLOT_IDLE, SLOT_OPEN, SLOT_READ, SLOT_CLOSE };
+
+struct slot {
+	enum slot_state state;
+	int file;               /* index in the batch */
+	int fd;
+	uint64_t off;
+	uint64_t left;          /* bytes left before the limit */
+	unsigned int len;       /* size of the read in flight */
+	int failed;             /* file status already holds an error */
+	unsigned char *buf;
+	struct jc_hash_ctx ctx;
+};
+
+
+static void uring_free(struct uring * const restrict r)
+{
+	if (r->sqes != NULL) munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != NULL && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+	if (r->sq_ring != NULL) munmap(r->sq_ring, r->sq_ring_size);
+	if (r->fd >= 0) close(r->fd);
+	return;
+}
+
+
+static int uring_setup(struct uring * const restrict r, const unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(r, 0, sizeof(struct uring));
+	memset(&p, 0, sizeof(struct io_uring_params));
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0) return -1;
+
+	r->sq_ring_size = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+	r->cq_ring_size = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) goto error;
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) r->cq_ring = r->sq_ring;
+	else {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) goto error;
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) goto error;
+
+	r->sq_head = (unsigned int *)((char *)r->sq_ring + p.sq_off.head);
+	r->sq_tail = (unsigned int *)((char *)r->sq_ring + p.sq_off.tail);
+	r->sq_mask = (unsigned int *)((char *)r->sq_ring + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)((char *)r->sq_ring + p.sq_off.array);
+	r->cq_head = (unsigned int *)((char *)r->cq_ring + p.cq_off.head);
+	r->cq_tail = (unsigned int *)((char *)r->cq_ring + p.cq_off.tail);
+	r->cq_mask = (unsigned int *)((char *)r->cq_ring + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring + p.cq_off.cqes);
+	return 0;
+
+error:
+	if (r->sq_ring == MAP_FAILED) r->sq_ring = NULL;
+	if (r->cq_ring == MAP_FAILED) r->cq_ring = NULL;
+	if (r->sqes == MAP_FAILED) r->sqes = NULL;
+	uring_free(r);
+	return -1;
+}
+
+
+/* Returns 1 if the kernel supports every operation the batch needs */
+static int uring_probe(const struct uring * const restrict r, int *fixed)
+{
+	const size_t size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe *probe;
+	int ok = 0;
+
+	probe = (struct io_uring_probe *)calloc(1, size);
+	if (probe == NULL) return 0;
+	if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+		ok = probe->last_op >= IORING_OP_CLOSE
+			&& (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) != 0
+			&& (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0
+			&& (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED) != 0;
+		*fixed = (probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED) != 0;
+	}
+	free(probe);
+	return ok;
+}
+
+
+/* Queue one operation for slot s; there is always room because each
+ * slot has at most one operation in flight */
+static void uring_queue(struct uring * const restrict r, const uint8_t opcode, const int fd, const void *addr, const unsigned int len, const uint64_t off, const unsigned int s)
+{
+	const unsigned int tail = *(r->sq_tail);
+	const unsigned int idx = tail & *(r->sq_mask);
+	struct io_uring_sqe *sqe = &(r->sqes[idx]);
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)addr;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = s;
+	if (opcode == IORING_OP_OPENAT) sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	if (opcode == IORING_OP_READ_FIXED) sqe->buf_index = (uint16_t)s;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->pending++;
+	return;
+}
+
+
+/* Submit what is queued and wait for at least one completion */
+static int uring_enter(struct uring * const restrict r)
+{
+	long ret;
+
+	for (;;) {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->pending, 1U, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret >= 0) break;
+		if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+	}
+	r->pending -= (unsigned int)ret;
+	return 0;
+}
+
+
+/* Wait for every slot's operation to complete and close any file the
+ * batch still has open; returns -1 if the ring can't be waited on */
+static int uring_drain(struct uring * const restrict r, struct slot * const restrict slots, const unsigned int depth)
+{
+	struct io_uring_cqe *cqe;
+	struct slot *sl;
+	unsigned int head, s, inflight = 0;
+
+	for (s = 0; s < depth; s++) if (slots[s].state != SLOT_IDLE) inflight++;
+	while (inflight > 0) {
+		if (uring_enter(r) != 0) return -1;
+		head = *(r->cq_head);
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &(r->cqes[head & *(r->cq_mask)]);
+			sl = &slots[(unsigned int)cqe->user_data];
+			if (sl->state == SLOT_OPEN && cqe->res >= 0) close(cqe->res);
+			else if (sl->state == SLOT_READ) close(sl->fd);
+			if (sl->state != SLOT_IDLE) inflight--;
+			sl->state = SLOT_IDLE;
+			head++;
+			__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+		}
+	}
+	return 0;
+}
+
+
+static int hash_batch_uring(struct jc_fileinfo_batch * const restrict batch, const enum jc_e_hash type, jodyhash_t *hashes, const uint64_t limit, unsigned int depth)
+{
+	const size_t stride = hash_stride(type);
+	struct uring r;
+	struct slot *slots = NULL;
+	struct iovec *iov = NULL;
+	struct io_uring_cqe *cqe;
+	struct slot *sl;
+	unsigned char *bufs = NULL;
+	unsigned int head, s, active = 0;
+	uint8_t read_op = IORING_OP_READ;
+	int fixed = 0, next = 0, res;
+
+	if ((unsigned int)batch->count < depth) depth = (unsigned int)batch->count;
+	if (uring_setup(&r, depth) != 0) return 1;
+	if (uring_probe(&r, &fixed) == 0) goto fallback;
+
+	slots = (struct slot *)calloc(depth, sizeof(struct slot));
+	iov = (struct iovec *)calloc(depth, sizeof(struct iovec));
+	if (slots == NULL || iov == NULL) goto fallback;
+	bufs = (unsigned char *)jc_pool_get((size_t)depth * JC_HASH_BATCH_BUFSIZE);
+	if (bufs == NULL) goto fallback;
+	for (s = 0; s < depth; s++) {
+		slots[s].buf = bufs + ((size_t)s * JC_HASH_BATCH_BUFSIZE);
+		iov[s].iov_base = slots[s].buf;
+		iov[s].iov_len = JC_HASH_BATCH_BUFSIZE;
+	}
+	/* Registered buffers save pinning pages on every read; they count
+	 * against RLIMIT_MEMLOCK on older kernels, so plain reads are fine too */
+	if (fixed != 0 && syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS, iov, depth) == 0)
+		read_op = IORING_OP_READ_FIXED;
+
+	/* Start a file in every slot */
+	for (s = 0; s < depth; s++) {
+		sl = &slots[s];
+		sl->file = next++;
+		sl->state = SLOT_OPEN;
+		sl->failed = 0;
+		jc_hash_init(&(sl->ctx), type);
+		uring_queue(&r, IORING_OP_OPENAT, AT_FDCWD, batch->files[sl->file].dirent->d_name, 0, 0, s);
+		active++;
+	}
+
+	while (active > 0) {
+		if (uring_enter(&r) != 0) goto error;
+		head = *(r.cq_head);
+		while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &(r.cqes[head & *(r.cq_mask)]);
+			s = (unsigned int)cqe->user_data;
+			res = cqe->res;
+			head++;
+			__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+			sl = &slots[s];
+
+			switch (sl->state) {
+			case SLOT_OPEN:
+				if (res < 0) {
+					batch->files[sl->file].status = -res;
+					sl->failed = 1;
+					goto next_file;
+				}
+				sl->fd = res;
+				sl->off = 0;
+				sl->left = limit != 0 ? limit : UINT64_MAX;
+				goto queue_read;
+			case SLOT_READ:
+				if (res < 0) {
+					batch->files[sl->file].status = -res;
+					sl->failed = 1;
+					goto queue_close;
+				}
+				if (res > 0 && jc_hash_update(&(sl->ctx), sl->buf, (size_t)res) != 0) {
+					batch->files[sl->file].status = EIO;
+					sl->failed = 1;
+					goto queue_close;
+				}
+				sl->off += (uint64_t)res;
+				sl->left -= (uint64_t)res;
+				/* Short reads can happen before the end (FUSE, network
+				 * filesystems), so only a zero-byte read ends the file */
+				if (res == 0 || sl->left == 0) goto queue_close;
+				goto queue_read;
+			case SLOT_CLOSE:
+				if (sl->failed == 0) {
+					if (jc_hash_final(&(sl->ctx), hashes + ((size_t)sl->file * stride)) == 0)
+						batch->files[sl->file].status = 0;
+					else batch->files[sl->file].status = EIO;
+				}
+				goto next_file;
+			case SLOT_IDLE:
+			default:
+				continue;
+			}
+
+queue_read:
+			sl->len = sl->left < JC_HASH_BATCH_BUFSIZE ? (unsigned int)sl->left : JC_HASH_BATCH_BUFSIZE;
+			sl->state = SLOT_READ;
+			uring_queue(&r, read_op, sl->fd, sl->buf, sl->len, sl->off, s);
+			continue;
+queue_close:
+			sl->state = SLOT_CLOSE;
+			uring_queue(&r, IORING_OP_CLOSE, sl->fd, NULL, 0, 0, s);
+			continue;
+next_file:
+			if (next >= batch->count) {
+				sl->state = SLOT_IDLE;
+				active--;
+				continue;
+			}
+			sl->file = next++;
+			sl->state = SLOT_OPEN;
+			sl->failed = 0;
+			jc_hash_init(&(sl->ctx), type);
+			uring_queue(&r, IORING_OP_OPENAT, AT_FDCWD, batch->files[sl->file].dirent->d_name, 0, 0, s);
+		}
+	}
+
+	jc_pool_put(bufs, (size_t)depth * JC_HASH_BATCH_BUFSIZE);
+	free(iov);
+	free(slots);
+	uring_free(&r);
+	return 0;
+
+fallback:
+	jc_pool_put(bufs, (size_t)depth * JC_HASH_BATCH_BUFSIZE);
+	free(iov);
+	free(slots);
+	uring_free(&r);
+	return 1;
+
+error:
+	/* Closing the ring only queues cancellation of reads still in flight,
+	 * so wait for them before the buffers can be reused. If even that
+	 * fails the kernel may still write into bufs, so leak it instead. */
+	res = errno;
+	if (uring_drain(&r, slots, depth) == 0) {
+		jc_pool_put(bufs, (size_t)depth * JC_HASH_BATCH_BUFSIZE);
+		uring_free(&r);
+	} else {
+		/* Closes still in the submission queue never reached the kernel */
+		for (head = __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE); head != *(r.sq_tail); head++) {
+			sl = &slots[(unsigned int)r.sqes[r.sq_array[head & *(r.sq_mask)]].user_data];
+			if (sl->state == SLOT_CLOSE) close(sl->fd);
+		}
+		uring_free(&r);
+		for (s = 0; s < depth; s++)
+			if (slots[s].state == SLOT_READ) close(slots[s].fd);
+	}
+	free(iov);
+	free(slots);
+	jc_errno = res;
+	return -1;
+}
+#endif /* JC_IO_URING */
+
+
+/* Hash every file named by the batch dirents (paths relative to the
+ * current directory) with up to depth files in flight (0 = 32). hashes
+ * gets one jodyhash_t per file, two for NORMAL128, in batch order; limit
+ * works like jc_hash_file(). Each file's status is 0 or an errno value.
+ * Returns -1 with jc_errno = EIO if any file failed. */
+extern int jc_hash_batch(struct jc_fileinfo_batch * const restrict batch, const enum jc_e_hash type, jodyhash_t *hashes, const uint64_t limit, unsigned int depth)
+{
+	struct jc_hash_ctx ctx;
+	int i;
+
+	if (unlikely(batch == NULL || hashes == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	for (i = 0; i < batch->count; i++) {
+		if (unlikely(batch->files[i].dirent == NULL)) {
+			jc_errno = EFAULT;
+			return -1;
+		}
+		batch->files[i].status = ECANCELED;
+	}
+	/* Reject types that can't be streamed before touching any files */
+	if (jc_hash_init(&ctx, type) != 0) return -1;
+	if (batch->count <= 0) return 0;
+
+	if (depth == 0) depth = JC_HASH_BATCH_DEPTH;
+	if (depth > JC_HASH_BATCH_MAX_DEPTH) depth = JC_HASH_BATCH_MAX_DEPTH;
+#ifdef JC_IO_URING
+	i = hash_batch_uring(batch, type, hashes, limit, depth);
+	if (i < 0) return -1;
+	if (i > 0) hash_batch_serial(batch, type, hashes, limit);
+#else
+	hash_batch_serial(batch, type, hashes, limit);
+#endif /* JC_IO_URING */
+
+	for (i = 0; i < batch->count; i++) {
+		if (batch->files[i].status != 0) {
+			jc_errno = EIO;
+			return -1;
+		}
+	}
+	return 0;
+}
+#endif /* ON_WINDOWS */
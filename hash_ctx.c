@@ -0,0 +1,187 @@
+/* libjodycode: streaming jody_hash contexts
+ *
+ * jody_block_hash() needs every block but the last to be a multiple of
+ * sizeof(jodyhash_t). These functions accept any amount of data per call
+ * and carry the partial word and rolling block position between calls,
+ * producing the same hash as hashing everything with jc_block_hash().
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "libjodycode.h"
+#include "crc32c.h"
+#include "jody_hash.h"
+#include "likely_unlikely.h"
+
+
+typedef int (*word_hash_t)(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+
+/* Block hash used for whole words (ROLLING hashes its blocks with NORMAL) */
+static word_hash_t word_hash(const enum jc_e_hash type)
+{
+	if (type == NORMAL128) return jody_block_hash128;
+	if (type == SEEDED) return jody_seeded_block_hash;
+	return jody_block_hash;
+}
+
+
+/* Feed data into a running NORMAL hash, buffering any partial word */
+static int feed_words(struct jc_hash_ctx * const restrict ctx, jodyhash_t *acc, const unsigned char *data, size_t len)
+{
+	const word_hash_t block_hash = word_hash(ctx->type);
+	size_t fill;
+
+	if (ctx->partial_len > 0) {
+		fill = sizeof(jodyhash_t) - ctx->partial_len;
+		if (fill > len) fill = len;
+		memcpy((unsigned char *)&(ctx->partial) + ctx->partial_len, data, fill);
+		ctx->partial_len += fill;
+		data += fill;
+		len -= fill;
+		if (ctx->partial_len < sizeof(jodyhash_t)) return 0;
+		if (block_hash(&(ctx->partial), acc, sizeof(jodyhash_t)) != 0) return 1;
+		ctx->partial_len = 0;
+	}
+
+	fill = len & ~(sizeof(jodyhash_t) - 1);
+	if (fill > 0) {
+		if (block_hash((jodyhash_t *)(uintptr_t)data, acc, fill) != 0) return 1;
+		data += fill;
+		len -= fill;
+	}
+
+	if (len > 0) {
+		memcpy(&(ctx->partial), data, len);
+		ctx->partial_len = len;
+	}
+	return 0;
+}
+
+
+extern int jc_hash_init(struct jc_hash_ctx * const restrict ctx, const enum jc_e_hash type)
+{
+	if (unlikely(ctx == NULL)) goto error_null;
+	switch (type) {
+	case NORMAL:
+	case NORMAL128:
+	case ROLLING:
+	case ROLLING_MT:
+	case CRC32C:
+	case SEEDED:
+		break;
+	case STRIPED:
+	default:
+		jc_errno = EINVAL;
+		return -1;
+	}
+	jc_hash_prefetch_init();
+	memset(ctx, 0, sizeof(struct jc_hash_ctx));
+	ctx->type = type;
+	ctx->block_size = ROLLBSIZE;
+	return 0;
+
+error_null:
+	jc_errno = JC_ENULL;
+	return -1;
+}
+
+
+extern int jc_hash_update(struct jc_hash_ctx * const restrict ctx, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t blocks, fill;
+
+	if (unlikely(ctx == NULL || (data == NULL && len > 0))) goto error_null;
+	ctx->total += len;
+
+	if (ctx->type == NORMAL || ctx->type == NORMAL128 || ctx->type == SEEDED) {
+		if (feed_words(ctx, ctx->hash, p, len) != 0) goto error_hash;
+		return 0;
+	}
+	/* CRC32C chains at any length so nothing needs buffering */
+	if (ctx->type == CRC32C) {
+		if (len > 0 && crc32c_block_hash((jodyhash_t *)(uintptr_t)p, ctx->hash, len) != 0) goto error_hash;
+		return 0;
+	}
+
+	/* ROLLING: each block is hashed from zero and XORed in */
+	while (len > 0) {
+		/* Whole blocks at a block boundary go straight to the rolling hash */
+		if (ctx->block_pos == 0 && len >= ctx->block_size) {
+			blocks = len & ~(ctx->block_size - 1);
+			if (jody_rolling_block_hash_bs((jodyhash_t *)(uintptr_t)p, ctx->hash, blocks, ctx->block_size) != 0) goto error_hash;
+			p += blocks;
+			len -= blocks;
+			continue;
+		}
+		fill = ctx->block_size - ctx->block_pos;
+		if (fill > len) fill = len;
+		if (feed_words(ctx, &(ctx->block_hash), p, fill) != 0) goto error_hash;
+		ctx->block_pos += fill;
+		p += fill;
+		len -= fill;
+		if (ctx->block_pos == ctx->block_size) {
+			ctx->hash[0] ^= ctx->block_hash;
+			ctx->block_hash = 0;
+			ctx->block_pos = 0;
+		}
+	}
+	return 0;
+
+error_null:
+	jc_errno = JC_ENULL;
+	return -1;
+error_hash:
+	jc_errno = EIO;
+	return -1;
+}
+
+
+/* Hash any buffered tail and return the final hash (two jodyhash_t for
+ * NORMAL128); the context must be initialized again before reuse */
+extern int jc_hash_final(struct jc_hash_ctx * const restrict ctx, jodyhash_t *hash)
+{
+	if (unlikely(ctx == NULL || hash == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+
+	if (ctx->type == NORMAL || ctx->type == NORMAL128 || ctx->type == SEEDED) {
+		if (ctx->partial_len > 0 && word_hash(ctx->type)(&(ctx->partial), ctx->hash, ctx->partial_len) != 0) goto error_hash;
+		if (ctx->type == NORMAL128) hash[1] = ctx->hash[1];
+	} else if (ctx->block_pos > 0) {
+		if (ctx->partial_len > 0 && jody_block_hash(&(ctx->partial), &(ctx->block_hash), ctx->partial_len) != 0) goto error_hash;
+		ctx->hash[0] ^= ctx->block_hash;
+	}
+	ctx->partial_len = 0;
+	ctx->block_pos = 0;
+	ctx->block_hash = 0;
+	*hash = ctx->hash[0];
+	return 0;
+
+error_hash:
+	jc_errno = EIO;
+	return -1;
+}
+
+
+/* Change the ROLLING block size (4K by default); only allowed before any
+ * data is fed in. See jc_rolling_block_hash() for the allowed sizes. */
+extern int jc_hash_set_block_size(struct jc_hash_ctx * const restrict ctx, const size_t block_size)
+{
+	if (unlikely(ctx == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (unlikely((ctx->type != ROLLING && ctx->type != ROLLING_MT)
+			|| !JH_ROLL_BSIZE_VALID(block_size) || ctx->total != 0)) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	ctx->block_size = block_size;
+	return 0;
+}
@@ -0,0 +1,373 @@
+/* libjodycode: whole-file hashing
+ *
+ * jc_hash_fd() and jc_hash_file() hash a file, or just its first limit
+ * bytes, with buffered reads, a sequential mmap() or O_DIRECT reads. The
+ * result is the same as jc_block_hash() over the file contents no matter
+ * which backend is used.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "libjodycode.h"
+#include "jody_hash.h"
+#include "likely_unlikely.h"
+
+#ifndef ON_WINDOWS
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef NO_THREADS
+ #include <pthread.h>
+#endif
+
+/* Largest read buffer */
+#ifndef JC_HASH_IO_BUFSIZE
+ #define JC_HASH_IO_BUFSIZE 1048576
+#endif
+/* JC_HASH_IO_AUTO maps files of at least this many bytes and reads the
+ * rest; below this the mmap() and page fault setup costs more than it saves */
+#ifndef JC_HASH_IO_MMAP_MIN
+ #define JC_HASH_IO_MMAP_MIN 1048576
+#endif
+/* O_DIRECT buffer, offset and length alignment */
+#define JC_HASH_IO_ALIGN 4096
+/* JC_HASH_IO_THREADED: buffers between the reader and the hasher and
+ * the limits on their size, which is a quarter of the L2 cache */
+#define JC_HASH_IO_RING 4
+#define JC_HASH_IO_CHUNK_MIN 131072
+#define JC_HASH_IO_CHUNK_MAX 4194304
+
+
+/* Hash up to size bytes with read() or pread(); bufsize must be a multiple
+ * of JC_HASH_IO_ALIGN for O_DIRECT, which always asks for whole buffers */
+static int hash_read(const int fd, const int seekable, const int direct, uint64_t size, const size_t bufsize, struct jc_hash_ctx * const restrict ctx)
+{
+	void *buf;
+	off_t off = 0;
+	size_t want;
+	ssize_t got;
+
+	buf = jc_pool_get(bufsize);
+	if (buf == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	while (size > 0) {
+		want = (direct == 0 && size < bufsize) ? (size_t)size : bufsize;
+		if (seekable != 0) got = pread(fd, buf, want, off);
+		else got = read(fd, buf, want);
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0) goto error;
+		if (got == 0) break;
+		if ((uint64_t)got > size) got = (ssize_t)size;
+		if (jc_hash_update(ctx, buf, (size_t)got) != 0) {
+			errno = EIO;
+			goto error;
+		}
+		off += got;
+		size -= (uint64_t)got;
+	}
+	jc_pool_put(buf, bufsize);
+	return 0;
+
+error:
+	jc_pool_put(buf, bufsize);
+	return -1;
+}
+
+
+/* Hash a mapping of the first size bytes; returns 1 if mmap() failed and
+ * the caller should read the data instead */
+static int hash_mmap(const int fd, const size_t size, struct jc_hash_ctx * const restrict ctx)
+{
+	void *map;
+	int retval = 0;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) return 1;
+#ifdef MADV_SEQUENTIAL
+	madvise(map, size, MADV_SEQUENTIAL);
+#endif
+	if (jc_hash_update(ctx, map, size) != 0) {
+		errno = EIO;
+		retval = -1;
+	}
+	munmap(map, size);
+	return retval;
+}
+
+
+#ifndef NO_THREADS
+/* Reader thread -> hasher ring for JC_HASH_IO_THREADED */
+struct hash_pipe {
+	pthread_mutex_t lock;
+	pthread_cond_t filled;   /* a buffer was filled or the reader is done */
+	pthread_cond_t drained;  /* a buffer was hashed or the hasher quit */
+	int fd;
+	int seekable;
+	uint64_t size;           /* bytes left to read */
+	size_t chunk;
+	unsigned char *buf[JC_HASH_IO_RING];
+	size_t len[JC_HASH_IO_RING];
+	unsigned int head;       /* buffers hashed */
+	unsigned int tail;       /* buffers filled */
+	int done;                /* the reader has stopped */
+	int stop;                /* the hasher wants the reader to stop */
+	int error;               /* errno from a failed read */
+};
+
+
+static size_t pipe_chunk = 0;
+static pthread_once_t pipe_chunk_once = PTHREAD_ONCE_INIT;
+
+static void pipe_chunk_init(void)
+{
+	size_t chunk = 0;
+#ifdef __linux__
+	struct jc_proc_cacheinfo pci;
+
+	jc_get_proc_cacheinfo(&pci);
+	chunk = (pci.l2 != 0 ? pci.l2 : pci.l2d) / 4;
+#endif
+	if (chunk < JC_HASH_IO_CHUNK_MIN) chunk = JC_HASH_IO_CHUNK_MIN;
+	if (chunk > JC_HASH_IO_CHUNK_MAX) chunk = JC_HASH_IO_CHUNK_MAX;
+	chunk &= ~((size_t)JC_HASH_IO_ALIGN - 1);
+	pipe_chunk = chunk;
+	return;
+}
+
+
+/* The chunk size is fixed per process, so only look it up once */
+static size_t pipe_chunk_size(void)
+{
+	pthread_once(&pipe_chunk_once, pipe_chunk_init);
+	return pipe_chunk;
+}
+
+
+static void *pipe_reader(void *arg)
+{
+	struct hash_pipe * const p = (struct hash_pipe *)arg;
+	unsigned char *buf;
+	off_t off = 0;
+	size_t want;
+	ssize_t got;
+
+	pthread_mutex_lock(&(p->lock));
+	while (p->stop == 0 && p->size > 0) {
+		if (p->tail - p->head == JC_HASH_IO_RING) {
+			pthread_cond_wait(&(p->drained), &(p->lock));
+			continue;
+		}
+		buf = p->buf[p->tail % JC_HASH_IO_RING];
+		want = p->size < p->chunk ? (size_t)p->size : p->chunk;
+		pthread_mutex_unlock(&(p->lock));
+
+		do {
+			if (p->seekable != 0) got = pread(p->fd, buf, want, off);
+			else got = read(p->fd, buf, want);
+		} while (got < 0 && errno == EINTR);
+
+		pthread_mutex_lock(&(p->lock));
+		if (got < 0) p->error = errno;
+		if (got <= 0) break;
+		p->len[p->tail % JC_HASH_IO_RING] = (size_t)got;
+		p->tail++;
+		p->size -= (uint64_t)got;
+		off += got;
+		pthread_cond_signal(&(p->filled));
+	}
+	p->done = 1;
+	pthread_cond_signal(&(p->filled));
+	pthread_mutex_unlock(&(p->lock));
+	return NULL;
+}
+
+
+/* Read in a second thread while this one hashes, so the reads and the
+ * hashing overlap instead of taking turns. Returns 1 if the thread could
+ * not be started and the caller should read the data itself. */
+static int hash_pipelined(const int fd, const int seekable, const uint64_t size, struct jc_hash_ctx * const restrict ctx)
+{
+	struct hash_pipe p;
+	pthread_t reader;
+	unsigned char *bufs;
+	size_t len;
+	int retval = 0;
+
+	memset(&p, 0, sizeof(struct hash_pipe));
+	p.fd = fd;
+	p.seekable = seekable;
+	p.size = size;
+	p.chunk = pipe_chunk_size();
+	/* Small files don't need full size buffers */
+	if (size < p.chunk) p.chunk = (((size_t)size + JC_HASH_IO_ALIGN - 1) / JC_HASH_IO_ALIGN) * JC_HASH_IO_ALIGN;
+	bufs = (unsigned char *)jc_pool_get(p.chunk * JC_HASH_IO_RING);
+	if (bufs == NULL) return 1;
+	for (int i = 0; i < JC_HASH_IO_RING; i++) p.buf[i] = bufs + ((size_t)i * p.chunk);
+
+	pthread_mutex_init(&(p.lock), NULL);
+	pthread_cond_init(&(p.filled), NULL);
+	pthread_cond_init(&(p.drained), NULL);
+	if (pthread_create(&reader, NULL, pipe_reader, &p) != 0) {
+		retval = 1;
+		goto cleanup;
+	}
+
+	pthread_mutex_lock(&(p.lock));
+	for (;;) {
+		if (p.head == p.tail) {
+			if (p.done != 0) break;
+			pthread_cond_wait(&(p.filled), &(p.lock));
+			continue;
+		}
+		len = p.len[p.head % JC_HASH_IO_RING];
+		pthread_mutex_unlock(&(p.lock));
+
+		if (jc_hash_update(ctx, p.buf[p.head % JC_HASH_IO_RING], len) != 0) {
+			pthread_mutex_lock(&(p.lock));
+			p.stop = 1;
+			p.error = EIO;
+			break;
+		}
+
+		pthread_mutex_lock(&(p.lock));
+		p.head++;
+		pthread_cond_signal(&(p.drained));
+	}
+	pthread_cond_signal(&(p.drained));
+	pthread_mutex_unlock(&(p.lock));
+	pthread_join(reader, NULL);
+	if (p.error != 0) {
+		errno = p.error;
+		retval = -1;
+	}
+
+cleanup:
+	pthread_cond_destroy(&(p.drained));
+	pthread_cond_destroy(&(p.filled));
+	pthread_mutex_destroy(&(p.lock));
+	jc_pool_put(bufs, p.chunk * JC_HASH_IO_RING);
+	return retval;
+}
+#endif /* NO_THREADS */
+
+
+/* Hash a whole file, or only its first limit bytes if limit is not zero.
+ * Regular files are hashed from offset 0 without moving the file offset;
+ * pipes and other streams are hashed from where they are. STRIPED can't
+ * be used. JC_HASH_IO_AUTO reads small files and maps large ones, and
+ * the other backends fall back to reads where they aren't possible.
+ * JC_HASH_IO_THREADED reads in a second thread while hashing, which helps
+ * most with large files that aren't cached. NORMAL128 needs room for two
+ * jodyhash_t at *hash. */
+extern int jc_hash_fd(const int fd, const enum jc_e_hash type, jodyhash_t *hash, const uint64_t limit, enum jc_e_hash_io io)
+{
+	struct jc_hash_ctx ctx;
+	struct stat st;
+	uint64_t size;
+	size_t bufsize, blksize;
+	int seekable, retval;
+#ifdef O_DIRECT
+	int flags;
+#endif
+
+	if (unlikely(hash == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (unlikely(fd < 0)) {
+		jc_errno = EBADF;
+		return -1;
+	}
+	if (unlikely((unsigned int)io > JC_HASH_IO_THREADED)) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	jc_hash_prefetch_init();
+	if (jc_hash_init(&ctx, type) != 0) return -1;
+	if (fstat(fd, &st) != 0) goto error_with_errno;
+
+	seekable = S_ISREG(st.st_mode);
+	if (seekable != 0) {
+		size = (uint64_t)st.st_size;
+		if (limit != 0 && limit < size) size = limit;
+	} else {
+		size = limit != 0 ? limit : UINT64_MAX;
+		io = JC_HASH_IO_READ;
+	}
+	if (io == JC_HASH_IO_AUTO) io = size >= JC_HASH_IO_MMAP_MIN ? JC_HASH_IO_MMAP : JC_HASH_IO_READ;
+
+	/* Reads are whole st_blksize units up to JC_HASH_IO_BUFSIZE */
+	blksize = st.st_blksize > 0 ? (size_t)st.st_blksize : JC_HASH_IO_ALIGN;
+	if (blksize > JC_HASH_IO_BUFSIZE) blksize = JC_HASH_IO_BUFSIZE;
+	bufsize = JC_HASH_IO_BUFSIZE;
+	if (size < bufsize) bufsize = (((size_t)size + blksize - 1) / blksize) * blksize;
+	if (bufsize == 0) bufsize = blksize;
+
+	retval = 1;
+	if (io == JC_HASH_IO_MMAP && size > 0 && size <= SIZE_MAX) {
+		retval = hash_mmap(fd, (size_t)size, &ctx);
+		if (retval < 0) goto error_with_errno;
+	}
+#ifdef O_DIRECT
+	if (io == JC_HASH_IO_DIRECT && size > 0) {
+		flags = fcntl(fd, F_GETFL);
+		if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+			retval = hash_read(fd, 1, 1, size, ((bufsize + JC_HASH_IO_ALIGN - 1) / JC_HASH_IO_ALIGN) * JC_HASH_IO_ALIGN, &ctx);
+			fcntl(fd, F_SETFL, flags);
+			/* File systems without O_DIRECT support fail the first read */
+			if (retval != 0 && errno == EINVAL && jc_hash_init(&ctx, type) == 0) retval = 1;
+			else if (retval != 0) goto error_with_errno;
+		}
+	}
+#endif /* O_DIRECT */
+#ifndef NO_THREADS
+	if (io == JC_HASH_IO_THREADED && size > 0) {
+ #ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, 0, (off_t)size, POSIX_FADV_SEQUENTIAL);
+ #endif
+		retval = hash_pipelined(fd, seekable, size, &ctx);
+		if (retval < 0) goto error_with_errno;
+	}
+#endif
+
+	if (retval == 1) {
+#ifdef POSIX_FADV_SEQUENTIAL
+		if (seekable != 0) posix_fadvise(fd, 0, (off_t)size, POSIX_FADV_SEQUENTIAL);
+#endif
+		if (hash_read(fd, seekable, 0, size, bufsize, &ctx) != 0) goto error_with_errno;
+	}
+	return jc_hash_final(&ctx, hash);
+
+error_with_errno:
+	jc_errno = errno;
+	return -1;
+}
+
+
+extern int jc_hash_file(const char * const path, const enum jc_e_hash type, jodyhash_t *hash, const uint64_t limit, const enum jc_e_hash_io io)
+{
+	int fd, retval;
+
+	if (unlikely(path == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		jc_errno = errno;
+		return -1;
+	}
+	retval = jc_hash_fd(fd, type, hash, limit, io);
+	close(fd);
+	return retval;
+}
+#endif /* ON_WINDOWS */
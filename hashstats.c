@@ -0,0 +1,326 @@
+/* libjodycode: hash distribution and collision statistics
+ *
+ * Collects hashes and reports per-bit bias, hash table bucket loads and
+ * how often equal hashes belong to different data. Each hash comes with
+ * an id that identifies the data (a size and an independent hash, for
+ * example); equal hashes with equal ids are counted as real duplicates.
+ *
+ * Building with -DJC_TEST (make hashstats) gives a tool that reports all
+ * of this for the NORMAL, partial NORMAL and ROLLING hashes of files.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Distributed under The MIT License
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "likely_unlikely.h"
+#include "libjodycode.h"
+
+/* Bucket count limits are 2^bits */
+#define JC_HSTAT_MIN_BITS 1
+#define JC_HSTAT_MAX_BITS 28
+/* Initial number of hashes with room allocated */
+#define JC_HSTAT_ITEMS 4096
+
+
+extern int jc_hash_stats_init(struct jc_hash_stats * const restrict st, unsigned int bucket_bits)
+{
+	if (unlikely(st == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (bucket_bits == 0) bucket_bits = JC_HSTAT_BUCKET_BITS;
+	if (bucket_bits < JC_HSTAT_MIN_BITS || bucket_bits > JC_HSTAT_MAX_BITS) {
+		jc_errno = EINVAL;
+		return -1;
+	}
+	memset(st, 0, sizeof(struct jc_hash_stats));
+	st->bucket_bits = bucket_bits;
+	st->buckets = (uint64_t *)calloc((size_t)1 << bucket_bits, sizeof(uint64_t));
+	if (st->buckets == NULL) goto error_oom;
+	st->items = (struct jc_hash_stats_item *)malloc(JC_HSTAT_ITEMS * sizeof(struct jc_hash_stats_item));
+	if (st->items == NULL) goto error_oom;
+	st->alloc = JC_HSTAT_ITEMS;
+	return 0;
+
+error_oom:
+	jc_hash_stats_free(st);
+	jc_errno = ENOMEM;
+	return -1;
+}
+
+
+extern void jc_hash_stats_free(struct jc_hash_stats * const restrict st)
+{
+	if (st == NULL) return;
+	free(st->buckets);
+	free(st->items);
+	st->buckets = NULL;
+	st->items = NULL;
+	st->alloc = 0;
+	return;
+}
+
+
+/* Add one hash; id identifies the hashed data */
+extern int jc_hash_stats_add(struct jc_hash_stats * const restrict st, const jodyhash_t hash, const uint64_t id)
+{
+	struct jc_hash_stats_item *items;
+
+	if (unlikely(st == NULL || st->items == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	if (st->count == st->alloc) {
+		items = (struct jc_hash_stats_item *)realloc(st->items, st->alloc * 2 * sizeof(struct jc_hash_stats_item));
+		if (items == NULL) {
+			jc_errno = ENOMEM;
+			return -1;
+		}
+		st->items = items;
+		st->alloc *= 2;
+	}
+	st->items[st->count].hash = hash;
+	st->items[st->count].id = id;
+	st->count++;
+
+	for (unsigned int bit = 0; bit < sizeof(jodyhash_t) * 8; bit++)
+		st->bit_ones[bit] += (hash >> bit) & 1;
+	st->buckets[(uint64_t)hash & (((uint64_t)1 << st->bucket_bits) - 1)]++;
+	return 0;
+}
+
+
+static int item_cmp(const void *a, const void *b)
+{
+	const struct jc_hash_stats_item *x = (const struct jc_hash_stats_item *)a;
+	const struct jc_hash_stats_item *y = (const struct jc_hash_stats_item *)b;
+
+	if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+	if (x->id != y->id) return x->id < y->id ? -1 : 1;
+	return 0;
+}
+
+
+/* Summarize everything added so far. The hashes are sorted, so more can
+ * be added afterwards but the order they were added in is lost. */
+extern int jc_hash_stats_report(struct jc_hash_stats * const restrict st, struct jc_hash_stats_summary * const restrict r)
+{
+	double expect, diff, bias;
+	size_t nbuckets, i, j;
+
+	if (unlikely(st == NULL || r == NULL || st->items == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	nbuckets = (size_t)1 << st->bucket_bits;
+	memset(r, 0, sizeof(struct jc_hash_stats_summary));
+	r->count = st->count;
+	if (st->count == 0) return 0;
+
+	/* Per-bit bias: how far each bit is from being set half of the time */
+	for (i = 0; i < sizeof(jodyhash_t) * 8; i++) {
+		bias = ((double)st->bit_ones[i] / (double)st->count) - 0.5;
+		r->bit_bias[i] = bias;
+		if (bias < 0) bias = -bias;
+		if (bias > r->max_bit_bias) {
+			r->max_bit_bias = bias;
+			r->max_bias_bit = (unsigned int)i;
+		}
+	}
+
+	/* Bucket loads against a uniform distribution */
+	expect = (double)st->count / (double)nbuckets;
+	r->bucket_min = UINT64_MAX;
+	for (i = 0; i < nbuckets; i++) {
+		if (st->buckets[i] < r->bucket_min) r->bucket_min = st->buckets[i];
+		if (st->buckets[i] > r->bucket_max) r->bucket_max = st->buckets[i];
+		diff = (double)st->buckets[i] - expect;
+		r->bucket_chi2 += diff * diff / expect;
+		r->bucket_loads[st->buckets[i] < JC_HSTAT_LOADS - 1 ? st->buckets[i] : JC_HSTAT_LOADS - 1]++;
+	}
+	r->bucket_expect = expect;
+
+	/* Runs of equal hashes; a new id within a run is a false match */
+	qsort(st->items, st->count, sizeof(struct jc_hash_stats_item), item_cmp);
+	for (i = 0; i < st->count; i = j) {
+		for (j = i + 1; j < st->count && st->items[j].hash == st->items[i].hash; j++) {
+			r->matches++;
+			if (st->items[j].id != st->items[j - 1].id) r->false_matches++;
+		}
+		if (j - i > 1) r->match_groups++;
+	}
+	return 0;
+}
+
+
+#ifdef JC_TEST
+#ifndef ON_WINDOWS
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Bytes hashed for the partial hash, like a duplicate finder would */
+#define PARTIAL_SIZE 4096
+#define READ_SIZE 1048576
+
+static struct jc_hash_stats st_normal, st_partial, st_rolling;
+static size_t partial_size = PARTIAL_SIZE;
+static jodyhash_t *readbuf;
+static unsigned long files = 0, errors = 0;
+
+
+static void hash_file(const char * const path)
+{
+	struct jc_hash_ctx normal, partial, rolling, check;
+	jodyhash_t hn, hp, hr, hc[2];
+	uint64_t id, size = 0;
+	size_t got;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		errors++;
+		return;
+	}
+	jc_hash_init(&normal, NORMAL);
+	jc_hash_init(&partial, NORMAL);
+	jc_hash_init(&rolling, ROLLING);
+	jc_hash_init(&check, NORMAL128);
+	while ((got = fread(readbuf, 1, READ_SIZE, fp)) > 0) {
+		if (size < partial_size) jc_hash_update(&partial, readbuf, got < partial_size - size ? got : partial_size - size);
+		jc_hash_update(&normal, readbuf, got);
+		jc_hash_update(&rolling, readbuf, got);
+		jc_hash_update(&check, readbuf, got);
+		size += got;
+	}
+	if (ferror(fp)) errors++;
+	fclose(fp);
+	jc_hash_final(&normal, &hn);
+	jc_hash_final(&partial, &hp);
+	jc_hash_final(&rolling, &hr);
+	jc_hash_final(&check, hc);
+
+	/* Same size and same independent second NORMAL128 chain = same data */
+	id = hc[1] ^ (size * 0x9e3779b97f4a7c15ULL);
+	jc_hash_stats_add(&st_normal, hn, id);
+	jc_hash_stats_add(&st_partial, hp, id);
+	jc_hash_stats_add(&st_rolling, hr, id);
+	files++;
+	return;
+}
+
+
+static void scan_path(const char * const path)
+{
+	struct stat s;
+	struct dirent *de;
+	DIR *dir;
+	char *sub;
+	size_t len;
+
+	if (lstat(path, &s) != 0) {
+		errors++;
+		return;
+	}
+	if (S_ISREG(s.st_mode)) {
+		hash_file(path);
+		return;
+	}
+	if (!S_ISDIR(s.st_mode)) return;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		errors++;
+		return;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+		len = strlen(path) + strlen(de->d_name) + 2;
+		sub = (char *)malloc(len);
+		if (sub == NULL) jc_oom("scan_path");
+		snprintf(sub, len, "%s/%s", path, de->d_name);
+		scan_path(sub);
+		free(sub);
+	}
+	closedir(dir);
+	return;
+}
+
+
+static void print_report(const char * const name, struct jc_hash_stats * const st)
+{
+	struct jc_hash_stats_summary r;
+
+	if (jc_hash_stats_report(st, &r) != 0 || r.count == 0) return;
+	printf("%s:\n", name);
+	printf("  worst bit bias   %.5f (bit %u)\n", r.max_bit_bias, r.max_bias_bit);
+	printf("  buckets          %zu, %.2f expected per bucket, min %" PRIu64 " max %" PRIu64 ", chi^2 %.1f\n",
+			(size_t)1 << st->bucket_bits, r.bucket_expect, r.bucket_min, r.bucket_max, r.bucket_chi2);
+	printf("  bucket loads    ");
+	for (int i = 0; i < JC_HSTAT_LOADS; i++) printf(" %d%s:%" PRIu64, i, i == JC_HSTAT_LOADS - 1 ? "+" : "", r.bucket_loads[i]);
+	printf("\n  equal hashes     %" PRIu64 " in %" PRIu64 " groups, %" PRIu64 " not duplicates\n\n",
+			r.matches, r.match_groups, r.false_matches);
+	return;
+}
+
+
+int main(int argc, char **argv)
+{
+	char line[4096];
+	unsigned int bits = 0;
+	size_t len;
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i += 2) {
+		if (i + 1 >= argc) goto usage;
+		if (strcmp(argv[i], "-p") == 0) partial_size = (size_t)strtoull(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-b") == 0) bits = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+		else goto usage;
+	}
+	if (i >= argc) goto usage;
+
+	readbuf = (jodyhash_t *)malloc(READ_SIZE);
+	if (readbuf == NULL) jc_oom("main");
+	if (jc_hash_stats_init(&st_normal, bits) != 0 || jc_hash_stats_init(&st_partial, bits) != 0
+			|| jc_hash_stats_init(&st_rolling, bits) != 0) {
+		fprintf(stderr, "error: bad bucket bit count\n");
+		return 1;
+	}
+
+	/* "-" reads a list of paths from stdin */
+	for (; i < argc; i++) {
+		if (strcmp(argv[i], "-") != 0) {
+			scan_path(argv[i]);
+			continue;
+		}
+		while (fgets(line, sizeof(line), stdin) != NULL) {
+			len = strlen(line);
+			if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+			if (*line != '\0') scan_path(line);
+		}
+	}
+
+	printf("%lu files hashed, %lu errors\n\n", files, errors);
+	print_report("NORMAL", &st_normal);
+	printf("(partial: first %zu bytes)\n", partial_size);
+	print_report("NORMAL partial", &st_partial);
+	print_report("ROLLING", &st_rolling);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-p partial_bytes] [-b bucket_bits] path|- ...\n", argv[0]);
+	return 1;
+}
+#else
+int main(void)
+{
+	fprintf(stderr, "hashstats is not supported on Windows\n");
+	return 1;
+}
+#endif /* ON_WINDOWS */
+#endif /* JC_TEST */
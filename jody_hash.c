@@ -13,76 +13,226 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "jody_hash.h"
 #include "jody_hash_simd.h"
 #include "likely_unlikely.h"
 
-/* Rolling hash block size (4K by default) */
-#ifndef ROLLBSIZE
- #define ROLLBSIZE 4096
-#endif
-#define ROLLBSIZEW (ROLLBSIZE / sizeof(jodyhash_t))
-
 
 static const jodyhash_t jh_s_constant = JH_ROR2(JODY_HASH_CONSTANT);
 
-/* Hash a block of arbitrary size; must be divisible by sizeof(jodyhash_t)
- * The first block should pass an initial hash of zero.
- * All blocks after the first should pass hash as the value
- * returned by the last call to this function. This allows hashing
- * of any amount of data. If data is not divisible by the size of
- * jodyhash_t, it is MANDATORY that the caller provide a data buffer
- * which is divisible by sizeof(jodyhash_t). */
-extern int jody_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+/* Mix one element into a hash (the body of the normal hash loop) */
+static inline jodyhash_t jh_mix_element(jodyhash_t hash, jodyhash_t element)
 {
-	jodyhash_t element, element2;
-	size_t length = 0;
+	jodyhash_t element2;
 
-	/* Don't bother trying to hash a zero-length block */
-	if (unlikely(count == 0)) return 0;
+	element2 = JH_ROR(element);
+	element2 ^= jh_s_constant;
+	element += JODY_HASH_CONSTANT;
+	hash += element;
+	hash ^= element2;
+	hash = JH_ROL2(hash);
+	hash += element;
+	return hash;
+}
 
-#ifndef NO_AVX2
-#if defined __GNUC__ || defined __clang__
-	__builtin_cpu_init ();
-	if (__builtin_cpu_supports ("avx2")) {
-#endif /* __GNUC__ || __clang__ */
-		if (count >= 32) {
-			if (jody_block_hash_avx2(&data, hash, count, &length) != 0) return 1;
-			goto skip_sse2;
-		} else length = count / sizeof(jodyhash_t);
-#if defined __GNUC__ || defined __clang__
-	} else length = count / sizeof(jodyhash_t);
+/* Mix the zero-padded last partial word of a block */
+static inline jodyhash_t jh_mix_tail(jodyhash_t hash, jodyhash_t element)
+{
+	jodyhash_t element2;
+
+	element2 = JH_ROR(element);
+	element2 ^= jh_s_constant;
+	element += JODY_HASH_CONSTANT;
+	hash += element;
+	hash ^= element2;
+	hash = JH_ROL2(hash);
+	hash += element2;
+	return hash;
+}
+
+/* Load the last partial word of a block. Only the bytes that are part of
+ * the data are read; on little-endian machines the result is the same as
+ * the old (*data & tail_mask[length]) which could read past the end. */
+static inline jodyhash_t jh_load_tail(const jodyhash_t * const data, const size_t length)
+{
+	jodyhash_t element = 0;
+
+	memcpy(&element, data, length);
+	return element;
+}
+
+/* SIMD kernels; the best supported one is picked once and can be overridden.
+ * The 32-bit and 16-bit widths only have SSE2 and AVX2 block kernels. */
+struct jh_kernel {
+	const char *name;
+	int (*block)(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant);
+	int (*block128)(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length);
+	int (*cmp)(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, size_t *mismatch);
+	int (*striped)(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length);
+	int (*multi)(jodyhash_t **data, jodyhash_t *hash, const size_t count);
+	size_t multi_lanes;
+};
+
+static const struct jh_kernel jh_kernels[JH_KERNEL_COUNT] = {
+	{ "auto",   NULL, NULL, NULL, NULL, NULL, 0 },
+	{ "scalar", NULL, NULL, NULL, NULL, NULL, 0 },
+#if !defined NO_SSE2 && JODY_HASH_WIDTH == 64
+	{ "sse2",   jody_block_hash_sse2, NULL, jody_block_hash_cmp_sse2, jody_striped_block_hash_sse2, jody_block_hash_multi_sse2, 2 },
+#elif !defined NO_SSE2
+	{ "sse2",   jody_block_hash_sse2, NULL, NULL, NULL, NULL, 0 },
+#else
+	{ "sse2",   NULL, NULL, NULL, NULL, NULL, 0 },
+#endif
+#if !defined NO_AVX2 && JODY_HASH_WIDTH == 64
+	{ "avx2",   jody_block_hash_avx2, jody_block_hash128_avx2, jody_block_hash_cmp_avx2, jody_striped_block_hash_avx2, jody_block_hash_multi_avx2, 4 },
+#elif !defined NO_AVX2
+	{ "avx2",   jody_block_hash_avx2, NULL, NULL, NULL, NULL, 0 },
+#else
+	{ "avx2",   NULL, NULL, NULL, NULL, NULL, 0 },
+#endif
+	/* AVX-512 CPUs all have AVX2, which is plenty for the compare kernel */
+#if !defined NO_AVX512 && !defined NO_AVX2
+	{ "avx512", jody_block_hash_avx512, jody_block_hash128_avx512, jody_block_hash_cmp_avx2, jody_striped_block_hash_avx512, jody_block_hash_multi_avx512, 8 },
+#elif !defined NO_AVX512
+	{ "avx512", jody_block_hash_avx512, jody_block_hash128_avx512, NULL, jody_striped_block_hash_avx512, jody_block_hash_multi_avx512, 8 },
+#else
+	{ "avx512", NULL, NULL, NULL, NULL, NULL, 0 },
 #endif
+};
+
+static const struct jh_kernel *jh_kernel = NULL;
+static int jh_kernel_id = JH_KERNEL_SCALAR;
+
+/* Large buffer mode: buffers of at least jh_pf_threshold bytes are hashed
+ * in JH_PF_CHUNK pieces, each preceded by low-locality prefetches of the
+ * data jh_pf_distance bytes ahead. JH_PF_LOCALITY 0 uses non-temporal
+ * (NTA) prefetches instead, which pollute the caches even less but were
+ * much slower than the default T2 hint on the systems tested. */
+#if defined __GNUC__ || defined __clang__
+ #define JH_PREFETCH(a) __builtin_prefetch((a), 0, JH_PF_LOCALITY)
+#elif defined _MSC_VER && !defined NO_SIMD
+ #if JH_PF_LOCALITY == 0
+  #define JH_PREFETCH(a) _mm_prefetch((const char *)(a), _MM_HINT_NTA)
+ #else
+  #define JH_PREFETCH(a) _mm_prefetch((const char *)(a), _MM_HINT_T2)
+ #endif
 #else
-	length = count / sizeof(jodyhash_t);
-#endif /* NO_AVX2 */
+ #define JH_PREFETCH(a)
+#endif
+static size_t jh_pf_distance = JH_PF_DISTANCE;
+static size_t jh_pf_threshold = JH_PF_THRESHOLD;
+
+
+/* Set prefetch distance and the size at which prefetching starts */
+extern int jody_hash_set_prefetch(const size_t distance, const size_t threshold)
+{
+	if (distance < JH_PF_LINE || distance > JH_PF_MAX_DISTANCE) return 1;
+	jh_pf_distance = distance & ~((size_t)JH_PF_LINE - 1);
+	jh_pf_threshold = threshold;
+	return 0;
+}
 
 
-#ifndef NO_SSE2
+/* Prefetch the cache lines jh_pf_distance ahead of [data, data + len) */
+static inline void jh_prefetch(const jodyhash_t * const data, const size_t len, const char * const end)
+{
+	const char *p = (const char *)data + jh_pf_distance;
+	const char *stop = p + len;
+
+	if (stop > end) stop = end;
+	for (; p < stop; p += JH_PF_LINE) JH_PREFETCH(p);
+	return;
+}
+
+
+/* Is a kernel both compiled in and supported by this CPU? */
+static int jh_kernel_supported(const int kernel)
+{
+	if (kernel == JH_KERNEL_SCALAR) return 1;
+	if (kernel <= JH_KERNEL_AUTO || kernel >= JH_KERNEL_COUNT) return 0;
+	if (jh_kernels[kernel].block == NULL) return 0;
 #if defined __GNUC__ || defined __clang__
 	__builtin_cpu_init ();
-	if (__builtin_cpu_supports ("sse2")) {
+	switch (kernel) {
+		case JH_KERNEL_SSE2: return __builtin_cpu_supports ("sse2");
+		case JH_KERNEL_AVX2: return __builtin_cpu_supports ("avx2");
+		case JH_KERNEL_AVX512: return __builtin_cpu_supports ("avx512f");
+		default: return 0;
+	}
+#else
+	return 1;
 #endif /* __GNUC__ || __clang__ */
-		if (count >= 32) {
-			if (jody_block_hash_sse2(&data, hash, count, &length) != 0) return 1;
-		}
-		else length = count / sizeof(jodyhash_t);
+}
+
+
+/* Probe the CPU once and use the fastest kernel it supports */
 #if defined __GNUC__ || defined __clang__
-	} else length = count / sizeof(jodyhash_t);
+__attribute__((constructor))
 #endif
-#else
-	length = count / sizeof(jodyhash_t);
-#endif /* NO_SSE2 */
+static void jh_kernel_init(void)
+{
+	int kernel;
 
-#ifndef NO_AVX2
-skip_sse2:
-#endif
-	/* Hash everything (normal) or remaining small tails (SSE2) */
+	for (kernel = JH_KERNEL_COUNT - 1; kernel > JH_KERNEL_SCALAR; kernel--)
+		if (jh_kernel_supported(kernel)) break;
+	jh_kernel_id = kernel;
+	jh_kernel = &jh_kernels[kernel];
+	return;
+}
+
+
+/* Override the automatic kernel choice; returns 1 if not available */
+extern int jody_hash_set_kernel(const int kernel)
+{
+	if (kernel == JH_KERNEL_AUTO) {
+		jh_kernel_init();
+		return 0;
+	}
+	if (!jh_kernel_supported(kernel)) return 1;
+	jh_kernel_id = kernel;
+	jh_kernel = &jh_kernels[kernel];
+	return 0;
+}
+
+
+extern int jody_hash_get_kernel(void)
+{
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	return jh_kernel_id;
+}
+
+
+extern const char *jody_hash_kernel_name(const int kernel)
+{
+	if (kernel < JH_KERNEL_AUTO || kernel >= JH_KERNEL_COUNT) return NULL;
+	return jh_kernels[kernel].name;
+}
+
+
+/* Hash a block of arbitrary size; must be divisible by sizeof(jodyhash_t)
+ * The first block should pass an initial hash of zero.
+ * All blocks after the first should pass hash as the value
+ * returned by the last call to this function. This allows hashing
+ * of any amount of data. Only the last block may have a size that is
+ * not divisible by sizeof(jodyhash_t); no bytes past data + count are
+ * ever read, so no padding is needed (e.g. when hashing mmap()ed files). */
+static inline int jh_block_hash_const(jodyhash_t *data, jodyhash_t *hash, const size_t count, const jodyhash_t constant)
+{
+	const jodyhash_t s_constant = JH_ROR2(constant);
+	jodyhash_t element, element2;
+	size_t length = 0;
+
+	if (jh_kernel->block != NULL && count >= 32) {
+		if (jh_kernel->block(&data, hash, count, &length, constant) != 0) return 1;
+	} else length = count / sizeof(jodyhash_t);
+
+	/* Hash everything (normal) or remaining small tails (SIMD) */
 	for (; length > 0; length--) {
 		element = *data;
 		element2 = JH_ROR(element);
-		element2 ^= jh_s_constant;
-		element += JODY_HASH_CONSTANT;
+		element2 ^= s_constant;
+		element += constant;
 		*hash += element;
 		*hash ^= element2;
 		*hash = JH_ROL2(*hash);
@@ -93,10 +243,10 @@ skip_sse2:
 	/* Handle data tail (for blocks indivisible by sizeof(jodyhash_t)) */
 	length = count & (sizeof(jodyhash_t) - 1);
 	if (length) {
-		element = *data & tail_mask[length];
+		element = jh_load_tail(data, length);
 		element2 = JH_ROR(element);
-		element2 ^= jh_s_constant;
-		element += JODY_HASH_CONSTANT;
+		element2 ^= s_constant;
+		element += constant;
 		*hash += element;
 		*hash ^= element2;
 		*hash = JH_ROL2(*hash);
@@ -107,24 +257,445 @@ skip_sse2:
 }
 
 
-extern int jody_rolling_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+static inline int jh_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	return jh_block_hash_const(data, hash, count, JODY_HASH_CONSTANT);
+}
+
+
+/* Large buffer mode; chunks are whole words so chaining is exact */
+static int jh_block_hash_chunked(int (*block_hash)(jodyhash_t *, jodyhash_t *, const size_t), jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	const char *end = (const char *)data + count;
+	size_t chunk;
+
+	for (size_t left = count; left > 0; left -= chunk) {
+		chunk = left > JH_PF_CHUNK ? JH_PF_CHUNK : left;
+		jh_prefetch(data, chunk, end);
+		if (block_hash(data, hash, chunk) != 0) return 1;
+		data += chunk / sizeof(jodyhash_t);
+	}
+	return 0;
+}
+
+
+extern int jody_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	/* Don't bother trying to hash a zero-length block */
+	if (unlikely(count == 0)) return 0;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	if (likely(count < jh_pf_threshold)) return jh_block_hash(data, hash, count);
+	return jh_block_hash_chunked(jh_block_hash, data, hash, count);
+}
+
+
+/* Seeded variant: the normal hash with the constant mixed with a
+ * per-process key, so colliding inputs can't be worked out in advance.
+ * Zero means no key has been set yet; one is picked at random then. */
+static jodyhash_t jh_seed_constant = 0;
+
+static jodyhash_t jh_seed_to_constant(uint64_t seed)
+{
+	jodyhash_t constant;
+
+	/* splitmix64 finalizer so similar keys give unrelated constants */
+	seed += 0x9e3779b97f4a7c15ULL;
+	seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+	seed ^= seed >> 31;
+	constant = (jodyhash_t)(JODY_HASH_CONSTANT ^ seed);
+	return constant != 0 ? constant : JODY_HASH_CONSTANT;
+}
+
+
+/* Pick a random key on first use; if threads race, the first one wins */
+static jodyhash_t jh_seed_init(void)
+{
+	uint64_t seed = 0;
+	jodyhash_t constant;
+	FILE *fp;
+
+	fp = fopen("/dev/urandom", "rb");
+	if (fp != NULL) {
+		if (fread(&seed, sizeof(seed), 1, fp) != 1) seed = 0;
+		fclose(fp);
+	}
+	/* Per-process values in case /dev/urandom is missing */
+	seed ^= (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)&seed << 16) ^ (uint64_t)clock();
+	constant = jh_seed_to_constant(seed);
+#if defined __GNUC__ || defined __clang__
+	{
+		jodyhash_t expected = 0;
+		if (!__atomic_compare_exchange_n(&jh_seed_constant, &expected, constant, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			return expected;
+	}
+#else
+	jh_seed_constant = constant;
+#endif
+	return constant;
+}
+
+
+/* Set the key for seeded hashes; hashes made with other keys won't match */
+extern void jody_hash_set_seed(const uint64_t seed)
+{
+	jh_seed_constant = jh_seed_to_constant(seed);
+	return;
+}
+
+
+static int jh_seeded_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	jodyhash_t constant = jh_seed_constant;
+
+	if (unlikely(constant == 0)) constant = jh_seed_init();
+	return jh_block_hash_const(data, hash, count, constant);
+}
+
+
+/* Same as jody_block_hash() but with the seeded constant */
+extern int jody_seeded_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	/* Don't bother trying to hash a zero-length block */
+	if (unlikely(count == 0)) return 0;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	if (likely(count < jh_pf_threshold)) return jh_seeded_block_hash(data, hash, count);
+	return jh_block_hash_chunked(jh_seeded_block_hash, data, hash, count);
+}
+
+
+#if JODY_HASH_WIDTH == 64
+static const jodyhash_t jh128_s_constant = JH128_ROR2(JODY_HASH128_CONSTANT);
+
+static inline int jh_block_hash128(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	jodyhash_t element, element2, element3, element4;
+	jodyhash_t hash1, hash2;
+	size_t length = 0;
+
+	if (jh_kernel->block128 != NULL && count >= 32) {
+		if (jh_kernel->block128(&data, hash, count, &length) != 0) return 1;
+	} else length = count / sizeof(jodyhash_t);
+	hash1 = hash[0];
+	hash2 = hash[1];
+
+	/* The two chains are independent, so the CPU overlaps them */
+	for (; length > 0; length--) {
+		element = *data;
+		element2 = JH_ROR(element) ^ jh_s_constant;
+		element4 = JH128_ROR(element) ^ jh128_s_constant;
+		element3 = element + JODY_HASH128_CONSTANT;
+		element += JODY_HASH_CONSTANT;
+		hash1 += element;
+		hash2 += element3;
+		hash1 ^= element2;
+		hash2 ^= element4;
+		hash1 = JH_ROL2(hash1);
+		hash2 = JH128_ROL2(hash2);
+		hash1 += element;
+		hash2 += element3;
+		data++;
+	}
+
+	/* Handle data tail (for blocks indivisible by sizeof(jodyhash_t)) */
+	length = count & (sizeof(jodyhash_t) - 1);
+	if (length) {
+		element = jh_load_tail(data, length);
+		element2 = JH_ROR(element) ^ jh_s_constant;
+		element4 = JH128_ROR(element) ^ jh128_s_constant;
+		element3 = element + JODY_HASH128_CONSTANT;
+		element += JODY_HASH_CONSTANT;
+		hash1 += element;
+		hash2 += element3;
+		hash1 ^= element2;
+		hash2 ^= element4;
+		hash1 = JH_ROL2(hash1);
+		hash2 = JH128_ROL2(hash2);
+		hash1 += element2;
+		hash2 += element4;
+	}
+
+	hash[0] = hash1;
+	hash[1] = hash2;
+	return 0;
+}
+
+
+/* 128-bit variant; hash points to two jodyhash_t and is chained exactly
+ * like jody_block_hash(). hash[0] is the same as the normal jody_hash and
+ * hash[1] is a second chain with a different shift and constant. */
+extern int jody_block_hash128(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	/* Don't bother trying to hash a zero-length block */
+	if (unlikely(count == 0)) return 0;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	if (likely(count < jh_pf_threshold)) return jh_block_hash128(data, hash, count);
+	return jh_block_hash_chunked(jh_block_hash128, data, hash, count);
+}
+#endif /* JODY_HASH_WIDTH == 64 */
+
+
+/* Rolling hash body; the common block sizes are passed as constants so
+ * that each gets its own copy with the block math folded away */
+static inline int jh_rolling_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t bsize)
 {
 	jodyhash_t rollhash;
-	size_t blocks = (count & ~((uint64_t)ROLLBSIZE - 1)) / ROLLBSIZE;
-	for (unsigned int i = 0; i < blocks; i++) {
-//fprintf(stderr, "rolling([%u] %p, %016" PRIx64 ", %d)\n", i, (void *)data, *hash, ROLLBSIZE);
+	const size_t whole = count & ~(bsize - 1);
+	const jodyhash_t *stop = data + (whole / sizeof(jodyhash_t));
+	const char *end = (const char *)data + count;
+	const int prefetch = count >= jh_pf_threshold;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	for (; data < stop; data += bsize / sizeof(jodyhash_t)) {
 		rollhash = 0;
-		if (jody_block_hash(data, &rollhash, ROLLBSIZE)) return 1;
+		if (!prefetch) {
+			if (jh_block_hash(data, &rollhash, bsize)) return 1;
+		} else if (bsize <= JH_PF_CHUNK) {
+			jh_prefetch(data, bsize, end);
+			if (jh_block_hash(data, &rollhash, bsize)) return 1;
+		} else if (jh_block_hash_chunked(jh_block_hash, data, &rollhash, bsize)) return 1;
 		*hash ^= rollhash;
-		data += ROLLBSIZEW;
 	}
 	/* Hash the last block */
-	blocks = count - (blocks * ROLLBSIZE);
-	if (blocks > 0) {
-//fprintf(stderr, "rolltail(%p, %016" PRIx64 ", %d)\n", (void *)data, *hash, ROLLBSIZE);
+	if (count > whole) {
 		rollhash = 0;
-		if (jody_block_hash(data, &rollhash, blocks)) return 1;
+		if (jh_block_hash(data, &rollhash, count - whole)) return 1;
 		*hash ^= rollhash;
 	}
 	return 0;
 }
+
+
+/* Rolling hash with any power-of-two block size of at least one word */
+extern int jody_rolling_block_hash_bs(jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t bsize)
+{
+	if (unlikely(!JH_ROLL_BSIZE_VALID(bsize))) return 1;
+	switch (bsize) {
+	case 4096: return jh_rolling_block_hash(data, hash, count, 4096);
+	case 16384: return jh_rolling_block_hash(data, hash, count, 16384);
+	case 65536: return jh_rolling_block_hash(data, hash, count, 65536);
+	case 1048576: return jh_rolling_block_hash(data, hash, count, 1048576);
+	default: return jh_rolling_block_hash(data, hash, count, bsize);
+	}
+}
+
+
+extern int jody_rolling_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	return jody_rolling_block_hash_bs(data, hash, count, ROLLBSIZE);
+}
+
+
+/* Offset of the first differing byte of two words that differ */
+static inline size_t jh_word_diff(const jodyhash_t * const a, const jodyhash_t * const b)
+{
+	const unsigned char *x = (const unsigned char *)a;
+	const unsigned char *y = (const unsigned char *)b;
+	size_t i = 0;
+
+	while (x[i] == y[i]) i++;
+	return i;
+}
+
+
+/* Hash data[0] and data[1] and compare them in the same pass. *mismatch
+ * must start out as count and is only changed at the first difference. */
+static int jh_block_hash_cmp(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *mismatch)
+{
+	const jodyhash_t * const start = data[0];
+	jodyhash_t ea, eb;
+	size_t length = 0, offset;
+
+	if (jh_kernel->cmp != NULL && count >= 32) {
+		if (jh_kernel->cmp(data, hash, count, &length, mismatch) != 0) return 1;
+	} else length = count / sizeof(jodyhash_t);
+	offset = (size_t)(data[0] - start) * sizeof(jodyhash_t);
+
+	for (; length > 0; length--) {
+		if (*data[0] != *data[1] && *mismatch == count) *mismatch = offset + jh_word_diff(data[0], data[1]);
+		hash[0] = jh_mix_element(hash[0], *data[0]);
+		hash[1] = jh_mix_element(hash[1], *data[1]);
+		data[0]++;
+		data[1]++;
+		offset += sizeof(jodyhash_t);
+	}
+
+	length = count & (sizeof(jodyhash_t) - 1);
+	if (length) {
+		ea = jh_load_tail(data[0], length);
+		eb = jh_load_tail(data[1], length);
+		if (ea != eb && *mismatch == count) *mismatch = offset + jh_word_diff(&ea, &eb);
+		hash[0] = jh_mix_tail(hash[0], ea);
+		hash[1] = jh_mix_tail(hash[1], eb);
+	}
+	return 0;
+}
+
+
+/* Hash two buffers of count bytes (hash[0] and hash[1] chain exactly like
+ * jody_block_hash) while comparing them, so each cache line is only
+ * loaded once. *mismatch is the offset of the first differing byte, or
+ * count if the buffers are identical. */
+extern int jody_block_hash_cmp(jodyhash_t *data1, jodyhash_t *data2, jodyhash_t *hash, const size_t count, size_t *mismatch)
+{
+	jodyhash_t *data[2];
+	const char *end1 = (const char *)data1 + count;
+	const char *end2 = (const char *)data2 + count;
+	size_t chunk, diff;
+
+	*mismatch = count;
+	if (unlikely(count == 0)) return 0;
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+
+	data[0] = data1;
+	data[1] = data2;
+	if (likely(count < jh_pf_threshold)) return jh_block_hash_cmp(data, hash, count, mismatch);
+
+	/* Large buffer mode; see jh_block_hash_chunked() */
+	for (size_t done = 0; done < count; done += chunk) {
+		chunk = count - done > JH_PF_CHUNK ? JH_PF_CHUNK : count - done;
+		jh_prefetch(data[0], chunk, end1);
+		jh_prefetch(data[1], chunk, end2);
+		diff = chunk;
+		if (jh_block_hash_cmp(data, hash, chunk, &diff) != 0) return 1;
+		if (diff != chunk && *mismatch == count) *mismatch = done + diff;
+	}
+	return 0;
+}
+
+
+/* Hash n independent buffers, each exactly as jody_block_hash() would.
+ * SIMD kernels hash one buffer per vector lane; the part of each buffer
+ * that is common to its whole group is interleaved and every buffer's
+ * remainder and tail are finished separately. data[] is not modified. */
+extern int jody_block_hash_multi(jodyhash_t * const *data, jodyhash_t *hash, const size_t *count, const size_t n)
+{
+	jodyhash_t *gdata[JH_MULTI_MAX];
+	jodyhash_t ghash[JH_MULTI_MAX];
+	size_t lanes, group, common, i, j;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	lanes = jh_kernel->multi_lanes;
+
+	for (i = 0; i < n; i += group) {
+		group = 1;
+		common = 0;
+		if (jh_kernel->multi != NULL && (n - i) >= lanes) {
+			group = lanes;
+			common = count[i];
+			for (j = 1; j < group; j++) if (count[i + j] < common) common = count[i + j];
+			common &= ~((size_t)31);
+			if (common > 0) {
+				for (j = 0; j < group; j++) {
+					gdata[j] = data[i + j];
+					ghash[j] = hash[i + j];
+				}
+				if (jh_kernel->multi(gdata, ghash, common) != 0) return 1;
+				for (j = 0; j < group; j++) hash[i + j] = ghash[j];
+			}
+		}
+
+		for (j = 0; j < group; j++)
+			if (jody_block_hash(data[i + j] + (common / sizeof(jodyhash_t)), &hash[i + j], count[i + j] - common) != 0) return 1;
+	}
+	return 0;
+}
+
+
+/* ROLLING version of jody_block_hash_multi(); buffers that fit in a single
+ * rolling block are interleaved, larger ones are hashed one at a time */
+extern int jody_rolling_block_hash_multi(jodyhash_t * const *data, jodyhash_t *hash, const size_t *count, const size_t n)
+{
+	jodyhash_t *sdata[JH_MULTI_BATCH];
+	jodyhash_t shash[JH_MULTI_BATCH];
+	size_t scount[JH_MULTI_BATCH];
+	size_t idx[JH_MULTI_BATCH];
+	size_t i, j, small = 0;
+
+	for (i = 0; i < n; i++) {
+		if (count[i] > ROLLBSIZE) {
+			if (jody_rolling_block_hash(data[i], &hash[i], count[i]) != 0) return 1;
+			continue;
+		}
+		/* Each small buffer is one rolling block which starts from zero */
+		sdata[small] = data[i];
+		shash[small] = 0;
+		scount[small] = count[i];
+		idx[small] = i;
+		small++;
+		if (small == JH_MULTI_BATCH) {
+			if (jody_block_hash_multi(sdata, shash, scount, small) != 0) return 1;
+			for (j = 0; j < small; j++) hash[idx[j]] ^= shash[j];
+			small = 0;
+		}
+	}
+	if (small > 0) {
+		if (jody_block_hash_multi(sdata, shash, scount, small) != 0) return 1;
+		for (j = 0; j < small; j++) hash[idx[j]] ^= shash[j];
+	}
+	return 0;
+}
+
+
+/* Striped variant: consecutive words are spread across JH_STRIPE_LANES
+ * independent lanes that are only folded together at the end. No lane
+ * depends on any other lane, so the SIMD versions can keep the entire
+ * calculation in vector registers. The lanes are folded on every call,
+ * so unlike NORMAL, chained calls only produce repeatable results if the
+ * data is always split into the same blocks. The same tail rules as
+ * jody_block_hash() apply. */
+extern int jody_striped_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	jodyhash_t lanes[JH_STRIPE_LANES];
+	jodyhash_t element, element2;
+	const char *end;
+	size_t length = 0, done = 0;
+	unsigned int lane;
+
+	/* Don't bother trying to hash a zero-length block */
+	if (unlikely(count == 0)) return 0;
+
+	for (lane = 0; lane < JH_STRIPE_LANES; lane++) lanes[lane] = *hash;
+
+	if (unlikely(jh_kernel == NULL)) jh_kernel_init();
+	if (jh_kernel->striped != NULL && count >= 64) {
+		/* Large buffer mode; whole chunks keep the word-to-lane mapping */
+		if (unlikely(count >= jh_pf_threshold)) {
+			end = (const char *)data + count;
+			for (; done + JH_PF_CHUNK <= count; done += JH_PF_CHUNK) {
+				jh_prefetch(data, JH_PF_CHUNK, end);
+				if (jh_kernel->striped(&data, lanes, JH_PF_CHUNK, &length) != 0) return 1;
+			}
+		}
+		if (jh_kernel->striped(&data, lanes, count - done, &length) != 0) return 1;
+	} else length = count / sizeof(jodyhash_t);
+
+	/* Words not consumed by SIMD code continue round-robin from lane 0 */
+	for (lane = 0; length > 0; length--) {
+		lanes[lane] = jh_mix_element(lanes[lane], *data);
+		lane = (lane + 1) % JH_STRIPE_LANES;
+		data++;
+	}
+
+	/* Handle data tail (for blocks indivisible by sizeof(jodyhash_t)) */
+	length = count & (sizeof(jodyhash_t) - 1);
+	if (length) {
+		element = jh_load_tail(data, length);
+		element2 = JH_ROR(element);
+		element2 ^= jh_s_constant;
+		element += JODY_HASH_CONSTANT;
+		lanes[lane] += element;
+		lanes[lane] ^= element2;
+		lanes[lane] = JH_ROL2(lanes[lane]);
+		lanes[lane] += element2;
+	}
+
+	/* Fold the lanes in order, then the length so zero tails differ */
+	for (lane = 0; lane < JH_STRIPE_LANES; lane++) *hash = jh_mix_element(*hash, lanes[lane]);
+	*hash = jh_mix_element(*hash, (jodyhash_t)count);
+
+	return 0;
+}
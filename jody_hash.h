@@ -11,14 +11,60 @@ extern "C" {
 /* Required for uint64_t */
 #include <stdint.h>
 
-/* Width of a jody_hash. Changing this will also require
- * changing the width of tail masks to match. */
+/* Width of a jody_hash */
 #ifndef JODY_HASH_WIDTH
 #define JODY_HASH_WIDTH 64
 #endif
 
 /* Version increments when algorithm changes incompatibly */
 #define JODY_HASH_VERSION 7
+/* The striped variant is versioned separately from the normal algorithm */
+#define JODY_HASH_STRIPED_VERSION 1
+/* So is the 128-bit variant (64-bit width only) */
+#define JODY_HASH128_VERSION 1
+
+/* Default rolling hash block size (4K); must be a power of two */
+#ifndef ROLLBSIZE
+ #define ROLLBSIZE 4096
+#endif
+#define ROLLBSIZEW (ROLLBSIZE / sizeof(jodyhash_t))
+/* Block sizes accepted by jody_rolling_block_hash_bs() */
+#define JH_ROLL_BSIZE_VALID(bsize) ((bsize) >= sizeof(jodyhash_t) && ((bsize) & ((bsize) - 1)) == 0)
+/* Number of leaf hashes in a tree hash of count bytes */
+#define JH_TREE_LEAVES(count) (((count) + ROLLBSIZE - 1) / ROLLBSIZE)
+
+/* SIMD kernel IDs for jody_hash_set_kernel(); these must match enum
+ * jc_e_hash_kernel in libjodycode.h (checked in block_hash.c) */
+#define JH_KERNEL_AUTO   0
+#define JH_KERNEL_SCALAR 1
+#define JH_KERNEL_SSE2   2
+#define JH_KERNEL_AVX2   3
+#define JH_KERNEL_AVX512 4
+#define JH_KERNEL_COUNT  5
+
+/* Most buffers any multi-buffer SIMD kernel hashes at once */
+#define JH_MULTI_MAX 8
+/* Buffers gathered per pass by the rolling multi-buffer code */
+#define JH_MULTI_BATCH 64
+
+/* Number of independent lanes used by the striped variant */
+#define JH_STRIPE_LANES 8
+
+/* Large buffer prefetching: cache line size, hashing chunk size, default
+ * prefetch distance, the buffer size at which prefetching starts, and the
+ * prefetch locality hint (0 = non-temporal, 1 = T2) */
+#define JH_PF_LINE 64
+#define JH_PF_CHUNK 4096
+#define JH_PF_MAX_DISTANCE 65536
+#ifndef JH_PF_DISTANCE
+ #define JH_PF_DISTANCE 4096
+#endif
+#ifndef JH_PF_THRESHOLD
+ #define JH_PF_THRESHOLD 33554432
+#endif
+#ifndef JH_PF_LOCALITY
+ #define JH_PF_LOCALITY 1
+#endif
 
 /* DO NOT modify shifts/contants unless you know what you're doing. They were
  * chosen after lots of testing. Changes will likely cause lots of hash
@@ -33,52 +79,24 @@ extern "C" {
  * It is injected into the calculation to prevent a string of
  * identical bytes from easily producing an identical hash. */
 
-/* The tail mask table is used for block sizes that are
- * indivisible by the width of a jodyhash_t. It is ANDed with the
- * final jodyhash_t-sized element to zero out data in the buffer
- * that is not part of the data to be hashed. */
-
 /* Set hash parameters based on requested hash width */
 #if JODY_HASH_WIDTH == 64
 typedef uint64_t jodyhash_t;
 #ifndef JODY_HASH_CONSTANT
 #define JODY_HASH_CONSTANT           0x71812e0f5463d3c8ULL
 #endif
-static const jodyhash_t tail_mask[] = {
-	0x0000000000000000,
-	0x00000000000000ff,
-	0x000000000000ffff,
-	0x0000000000ffffff,
-	0x00000000ffffffff,
-	0x000000ffffffffff,
-	0x0000ffffffffffff,
-	0x00ffffffffffffff,
-	0xffffffffffffffff
-};
 #endif /* JODY_HASH_WIDTH == 64 */
 #if JODY_HASH_WIDTH == 32
 typedef uint32_t jodyhash_t;
 #ifndef JODY_HASH_CONSTANT
 #define JODY_HASH_CONSTANT 0x8748ee5dU
 #endif
-static const jodyhash_t tail_mask[] = {
-	0x00000000,
-	0x000000ff,
-	0x0000ffff,
-	0x00ffffff,
-	0xffffffff
-};
 #endif /* JODY_HASH_WIDTH == 32 */
 #if JODY_HASH_WIDTH == 16
 typedef uint16_t jodyhash_t;
 #ifndef JODY_HASH_CONSTANT
 #define JODY_HASH_CONSTANT 0x1f5bU
 #endif
-static const jodyhash_t tail_mask[] = {
-	0x0000,
-	0x00ff,
-	0xffff
-};
 #endif /* JODY_HASH_WIDTH == 16 */
 
 /* Double-length shift for double-rotation optimization */
@@ -91,9 +109,43 @@ static const jodyhash_t tail_mask[] = {
 #define JH_ROL2(a) (jodyhash_t)(a << JH_SHIFT2 | (a >> ((sizeof(jodyhash_t) * 8) - JH_SHIFT2)))
 #define JH_ROR2(a) (jodyhash_t)(a >> JH_SHIFT2 | (a << ((sizeof(jodyhash_t) * 8) - JH_SHIFT2)))
 
+/* Second chain of the 128-bit variant; same structure as the normal hash
+ * with a different shift and constant so the two halves don't share
+ * collisions. The first chain is the normal jody_hash. */
+#if JODY_HASH_WIDTH == 64
+#define JODY_HASH128_SHIFT 23
+#define JODY_HASH128_CONSTANT 0x9e3779b97f4a7c15ULL
+#define JH128_SHIFT2 (JODY_HASH128_SHIFT * 2)
+#define JODY_HASH128_CONSTANT_ROR2 (JODY_HASH128_CONSTANT >> JH128_SHIFT2 | (JODY_HASH128_CONSTANT << (64 - JH128_SHIFT2)))
+#define JH128_ROR(a)  (jodyhash_t)((a >> JODY_HASH128_SHIFT) | (a << (64 - JODY_HASH128_SHIFT)))
+#define JH128_ROL2(a) (jodyhash_t)(a << JH128_SHIFT2 | (a >> (64 - JH128_SHIFT2)))
+#define JH128_ROR2(a) (jodyhash_t)(a >> JH128_SHIFT2 | (a << (64 - JH128_SHIFT2)))
+#endif /* JODY_HASH_WIDTH == 64 */
+
 
 extern int jody_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count);
 extern int jody_rolling_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jody_rolling_block_hash_bs(jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t bsize);
+extern int jody_block_hash128(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jody_seeded_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern void jody_hash_set_seed(const uint64_t seed);
+extern int jody_striped_block_hash(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jody_block_hash_multi(jodyhash_t * const *data, jodyhash_t *hash, const size_t *count, const size_t n);
+extern int jody_block_hash_cmp(jodyhash_t *data1, jodyhash_t *data2, jodyhash_t *hash, const size_t count, size_t *mismatch);
+extern int jody_rolling_block_hash_mt(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jody_rolling_block_hash_mt_bs(jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t bsize);
+extern int jody_tree_leaves(jodyhash_t *data, const size_t count, jodyhash_t *leaves);
+extern int jody_tree_leaves_mt(jodyhash_t *data, const size_t count, jodyhash_t *leaves);
+extern jodyhash_t jody_tree_combine(const jodyhash_t left, const jodyhash_t right);
+extern jodyhash_t jody_tree_root(const jodyhash_t *leaves, const size_t n);
+extern int jody_hash_set_threads(const int threads);
+extern int jody_hash_set_prefetch(const size_t distance, const size_t threshold);
+/* libjodycode (block_hash.c): tune prefetching for this machine once */
+extern void jc_hash_prefetch_init(void);
+extern int jody_rolling_block_hash_multi(jodyhash_t * const *data, jodyhash_t *hash, const size_t *count, const size_t n);
+extern int jody_hash_set_kernel(const int kernel);
+extern int jody_hash_get_kernel(void);
+extern const char *jody_hash_kernel_name(const int kernel);
 
 #ifdef __cplusplus
 }
@@ -16,35 +16,30 @@
 #include "jody_hash_simd.h"
 
 #ifndef NO_AVX2
+#if JODY_HASH_WIDTH == 64
 
-int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length)
+/* constant is the hash constant to use, so seeded hashes need no rebuild */
+int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant)
 {
-	size_t vec_allocsize;
-	__m256i *aligned_data;
+	size_t vec_size;
+	__m256i *vec_data = (__m256i *)*data;
 	/* Regs used in groups of 3; 1=ROR/XOR work, 2=temp, 3=data+constant */
 	__m256i vx1, vx2, vx3;
 	__m256i avx_const, avx_ror2;
 	jodyhash_t qhash = *hash;
 
 	/* Constants preload */
-	avx_const = _mm256_load_si256(&vec_constant.v256);
-	avx_ror2  = _mm256_load_si256(&vec_constant_ror2.v256);
-
-	/* How much memory do we need to align the data? */
-	vec_allocsize = count & 0xffffffffffffffe0U;
-	/* Only alloc/copy if not already aligned */
-	if (((uintptr_t)*data & (uintptr_t)0x1fULL) != 0) {
-		aligned_data  = (__m256i *)aligned_alloc(32, vec_allocsize);
-		if (!aligned_data) return 1;
-		memcpy(aligned_data, *data, vec_allocsize);
-	} else aligned_data = (__m256i *)*data;
-
-	for (size_t i = 0; i < (vec_allocsize / 32); i++) {
-		vx1  = _mm256_load_si256(&aligned_data[i]);
-		vx3  = _mm256_load_si256(&aligned_data[i]);
+	avx_const = _mm256_set1_epi64x((long long)constant);
+	avx_ror2  = _mm256_set1_epi64x((long long)JH_ROR2(constant));
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 32); i++) {
+		vx3  = _mm256_loadu_si256(&vec_data[i]);
 
 		/* "element2" gets RORed (two logical shifts ORed together) */
-		vx1  = _mm256_srli_epi64(vx1, JODY_HASH_SHIFT);
+		vx1  = _mm256_srli_epi64(vx3, JODY_HASH_SHIFT);
 		vx2  = _mm256_slli_epi64(vx3, (64 - JODY_HASH_SHIFT));
 		vx1  = _mm256_or_si256(vx1, vx2);
 		vx1  = _mm256_xor_si256(vx1, avx_ror2);  // XOR against the ROR2 constant
@@ -80,11 +75,324 @@ int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count
 			qhash += ep1;
 		}  // End of hash finish loop
 	}  // End of main AVX for loop
-	*data += vec_allocsize / sizeof(jodyhash_t);
-	if (((uintptr_t)*data & (uintptr_t)0x1fULL) != 0) ALIGNED_FREE(aligned_data);
-	*length = (count - vec_allocsize) / sizeof(jodyhash_t);
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	*hash = qhash;
+	return 0;
+}
+
+
+/* Hash two buffers and compare them in the same pass. The hash chains
+ * for the two buffers are independent, so they are interleaved. *mismatch
+ * is set to the offset of the first differing byte if it is still count. */
+int jody_block_hash_cmp_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, size_t *mismatch)
+{
+	size_t vec_size;
+	__m256i *vec_a = (__m256i *)data[0];
+	__m256i *vec_b = (__m256i *)data[1];
+	/* x = first buffer, y = second; 1=ROR/XOR work, 2=temp, 3=data+constant */
+	__m256i vx1, vx2, vx3, vy1, vy2, vy3;
+	__m256i avx_const, avx_ror2;
+	union {
+		__m256i v;
+		uint64_t e[4];
+	} ea1, ea2, eb1, eb2;
+	jodyhash_t ha = hash[0], hb = hash[1];
+	const unsigned char *ca, *cb;
+	unsigned int eq;
+	int found = *mismatch != count;
+
+	/* Constants preload */
+	avx_const = _mm256_load_si256(&vec_constant.v256[0]);
+	avx_ror2  = _mm256_load_si256(&vec_constant_ror2.v256[0]);
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 32); i++) {
+		vx3  = _mm256_loadu_si256(&vec_a[i]);
+		vy3  = _mm256_loadu_si256(&vec_b[i]);
+
+		/* Compare while the data is in registers */
+		if (!found) {
+			eq = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(vx3, vy3));
+			if (eq != 0xffffffffU) {
+				ca = (const unsigned char *)&vec_a[i];
+				cb = (const unsigned char *)&vec_b[i];
+				for (eq = 0; ca[eq] == cb[eq]; eq++);
+				*mismatch = (i * 32) + eq;
+				found = 1;
+			}
+		}
+
+		/* "element2" gets RORed (two logical shifts ORed together) */
+		vx1  = _mm256_srli_epi64(vx3, JODY_HASH_SHIFT);
+		vx2  = _mm256_slli_epi64(vx3, (64 - JODY_HASH_SHIFT));
+		vx1  = _mm256_or_si256(vx1, vx2);
+		ea2.v = _mm256_xor_si256(vx1, avx_ror2);  // XOR against the ROR2 constant
+		vy1  = _mm256_srli_epi64(vy3, JODY_HASH_SHIFT);
+		vy2  = _mm256_slli_epi64(vy3, (64 - JODY_HASH_SHIFT));
+		vy1  = _mm256_or_si256(vy1, vy2);
+		eb2.v = _mm256_xor_si256(vy1, avx_ror2);  // XOR against the ROR2 constant
+
+		/* Add the constant to "element" */
+		ea1.v = _mm256_add_epi64(vx3, avx_const);
+		eb1.v = _mm256_add_epi64(vy3, avx_const);
+
+		/* Perform the rest of both hashes */
+		for (int j = 0; j < 4; j++) {
+			ha += ea1.e[j];
+			hb += eb1.e[j];
+			ha ^= ea2.e[j];
+			hb ^= eb2.e[j];
+			ha = JH_ROL2(ha);
+			hb = JH_ROL2(hb);
+			ha += ea1.e[j];
+			hb += eb1.e[j];
+		}  // End of hash finish loop
+	}  // End of main AVX for loop
+	data[0] += vec_size / sizeof(jodyhash_t);
+	data[1] += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	hash[0] = ha;
+	hash[1] = hb;
+	return 0;
+}
+
+
+/* Striped hash: every 64-bit lane is an independent hash, so the mixing
+ * step runs entirely in vector registers. Two registers give eight lanes
+ * and keep two independent dependency chains in flight. */
+int jody_striped_block_hash_avx2(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length)
+{
+	size_t vec_size;
+	__m256i *vec_data = (__m256i *)*data;
+	/* x/y regs: 1=ROR/XOR work, 2=temp, 3=data+constant; acc = lane hashes */
+	__m256i vx1, vx2, vx3, vy1, vy2, vy3;
+	__m256i acc1, acc2;
+	__m256i avx_const, avx_ror2;
+
+	/* Constants preload */
+	avx_const = _mm256_load_si256(&vec_constant.v256[0]);
+	avx_ror2  = _mm256_load_si256(&vec_constant_ror2.v256[0]);
+
+	acc1 = _mm256_loadu_si256((__m256i *)lanes);
+	acc2 = _mm256_loadu_si256((__m256i *)(lanes + 4));
+
+	/* Only whole stripes of eight words are processed here */
+	vec_size = count & 0xffffffffffffffc0U;
+
+	for (size_t i = 0; i < (vec_size / 32); i += 2) {
+		vx3  = _mm256_loadu_si256(&vec_data[i]);
+		vy3  = _mm256_loadu_si256(&vec_data[i + 1]);
+
+		/* "element2" gets RORed (two logical shifts ORed together) */
+		vx1  = _mm256_srli_epi64(vx3, JODY_HASH_SHIFT);
+		vx2  = _mm256_slli_epi64(vx3, (64 - JODY_HASH_SHIFT));
+		vx1  = _mm256_or_si256(vx1, vx2);
+		vx1  = _mm256_xor_si256(vx1, avx_ror2);  // XOR against the ROR2 constant
+		vy1  = _mm256_srli_epi64(vy3, JODY_HASH_SHIFT);
+		vy2  = _mm256_slli_epi64(vy3, (64 - JODY_HASH_SHIFT));
+		vy1  = _mm256_or_si256(vy1, vy2);
+		vy1  = _mm256_xor_si256(vy1, avx_ror2);  // XOR against the ROR2 constant
+
+		/* Add the constant to "element" */
+		vx3  = _mm256_add_epi64(vx3, avx_const);
+		vy3  = _mm256_add_epi64(vy3, avx_const);
+
+		/* Mix into the lane hashes: add, XOR, ROL2, add */
+		acc1 = _mm256_add_epi64(acc1, vx3);
+		acc2 = _mm256_add_epi64(acc2, vy3);
+		acc1 = _mm256_xor_si256(acc1, vx1);
+		acc2 = _mm256_xor_si256(acc2, vy1);
+		vx2  = _mm256_slli_epi64(acc1, JH_SHIFT2);
+		vy2  = _mm256_slli_epi64(acc2, JH_SHIFT2);
+		acc1 = _mm256_srli_epi64(acc1, (64 - JH_SHIFT2));
+		acc2 = _mm256_srli_epi64(acc2, (64 - JH_SHIFT2));
+		acc1 = _mm256_or_si256(acc1, vx2);
+		acc2 = _mm256_or_si256(acc2, vy2);
+		acc1 = _mm256_add_epi64(acc1, vx3);
+		acc2 = _mm256_add_epi64(acc2, vy3);
+	}  // End of main AVX for loop
+
+	_mm256_storeu_si256((__m256i *)lanes, acc1);
+	_mm256_storeu_si256((__m256i *)(lanes + 4), acc2);
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	return 0;
+}
+
+
+/* One jody_hash step applied to four independent hashes at once */
+static inline __m256i jh_mix_x4(__m256i acc, __m256i element, const __m256i avx_const, const __m256i avx_ror2)
+{
+	__m256i element2, temp;
+
+	/* "element2" gets RORed (two logical shifts ORed together) */
+	element2 = _mm256_srli_epi64(element, JODY_HASH_SHIFT);
+	temp     = _mm256_slli_epi64(element, (64 - JODY_HASH_SHIFT));
+	element2 = _mm256_or_si256(element2, temp);
+	element2 = _mm256_xor_si256(element2, avx_ror2);
+	element  = _mm256_add_epi64(element, avx_const);
+
+	acc  = _mm256_add_epi64(acc, element);
+	acc  = _mm256_xor_si256(acc, element2);
+	temp = _mm256_slli_epi64(acc, JH_SHIFT2);
+	acc  = _mm256_srli_epi64(acc, (64 - JH_SHIFT2));
+	acc  = _mm256_or_si256(acc, temp);
+	acc  = _mm256_add_epi64(acc, element);
+	return acc;
+}
+
+
+/* Multi-buffer hash: one buffer per 64-bit lane. Each buffer's next four
+ * words are loaded and transposed so that every register holds the same
+ * word position from all four buffers. count must be a multiple of 32
+ * and is the number of bytes hashed from every buffer. */
+int jody_block_hash_multi_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count)
+{
+	__m256i r0, r1, r2, r3, t0, t1, t2, t3;
+	__m256i acc;
+	__m256i avx_const, avx_ror2;
+
+	/* Constants preload */
+	avx_const = _mm256_load_si256(&vec_constant.v256[0]);
+	avx_ror2  = _mm256_load_si256(&vec_constant_ror2.v256[0]);
+
+	acc = _mm256_loadu_si256((__m256i *)hash);
+
+	for (size_t i = 0; i < count / sizeof(jodyhash_t); i += 4) {
+		r0 = _mm256_loadu_si256((__m256i *)(data[0] + i));
+		r1 = _mm256_loadu_si256((__m256i *)(data[1] + i));
+		r2 = _mm256_loadu_si256((__m256i *)(data[2] + i));
+		r3 = _mm256_loadu_si256((__m256i *)(data[3] + i));
+
+		/* 4x4 transpose of 64-bit elements */
+		t0 = _mm256_unpacklo_epi64(r0, r1);
+		t1 = _mm256_unpackhi_epi64(r0, r1);
+		t2 = _mm256_unpacklo_epi64(r2, r3);
+		t3 = _mm256_unpackhi_epi64(r2, r3);
+		r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+		r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+		r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+		r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+		acc = jh_mix_x4(acc, r0, avx_const, avx_ror2);
+		acc = jh_mix_x4(acc, r1, avx_const, avx_ror2);
+		acc = jh_mix_x4(acc, r2, avx_const, avx_ror2);
+		acc = jh_mix_x4(acc, r3, avx_const, avx_ror2);
+	}
+
+	_mm256_storeu_si256((__m256i *)hash, acc);
+	for (int j = 0; j < 4; j++) data[j] += count / sizeof(jodyhash_t);
+	return 0;
+}
+
+
+/* 128-bit variant: the element math for both chains is done four words at
+ * a time and the two serial chains are then run side by side */
+int jody_block_hash128_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length)
+{
+	size_t vec_size;
+	__m256i *vec_data = (__m256i *)*data;
+	/* 1=ROR/XOR work, 2=temp, 3=data+constant; x=first chain, y=second */
+	__m256i vx1, vx2, vx3, vy1, vy2, vy3;
+	__m256i avx_const, avx_ror2, avx_const128, avx_ror2_128;
+	union UINT512 ex, ey;
+	jodyhash_t qhash1 = hash[0], qhash2 = hash[1];
+
+	/* Constants preload */
+	avx_const    = _mm256_load_si256(&vec_constant.v256[0]);
+	avx_ror2     = _mm256_load_si256(&vec_constant_ror2.v256[0]);
+	avx_const128 = _mm256_load_si256(&vec_constant128.v256[0]);
+	avx_ror2_128 = _mm256_load_si256(&vec_constant128_ror2.v256[0]);
+
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 32); i++) {
+		vx3  = _mm256_loadu_si256(&vec_data[i]);
+
+		/* "element2" gets RORed by each chain's shift and XORed */
+		vx1  = _mm256_srli_epi64(vx3, JODY_HASH_SHIFT);
+		vx2  = _mm256_slli_epi64(vx3, (64 - JODY_HASH_SHIFT));
+		vy1  = _mm256_srli_epi64(vx3, JODY_HASH128_SHIFT);
+		vy2  = _mm256_slli_epi64(vx3, (64 - JODY_HASH128_SHIFT));
+		vx1  = _mm256_or_si256(vx1, vx2);
+		vy1  = _mm256_or_si256(vy1, vy2);
+		vx1  = _mm256_xor_si256(vx1, avx_ror2);
+		vy1  = _mm256_xor_si256(vy1, avx_ror2_128);
+
+		/* Add each chain's constant to "element" */
+		vy3  = _mm256_add_epi64(vx3, avx_const128);
+		vx3  = _mm256_add_epi64(vx3, avx_const);
+
+		/* Perform the rest of the hash */
+		_mm256_store_si256(&ex.v256[0], vx3);
+		_mm256_store_si256(&ex.v256[1], vx1);
+		_mm256_store_si256(&ey.v256[0], vy3);
+		_mm256_store_si256(&ey.v256[1], vy1);
+		for (int j = 0; j < 4; j++) {
+			qhash1 += ex.v64[j];
+			qhash2 += ey.v64[j];
+			qhash1 ^= ex.v64[j + 4];
+			qhash2 ^= ey.v64[j + 4];
+			qhash1 = JH_ROL2(qhash1);
+			qhash2 = JH128_ROL2(qhash2);
+			qhash1 += ex.v64[j];
+			qhash2 += ey.v64[j];
+		}  // End of hash finish loop
+	}  // End of main AVX for loop
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	hash[0] = qhash1;
+	hash[1] = qhash2;
+	return 0;
+}
+
+#else /* JODY_HASH_WIDTH != 64 */
+
+/* 32-bit and 16-bit widths: a vector of elements is loaded, RORed and
+ * offset at once, then mixed into the hash in order like the scalar code */
+int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant)
+{
+	size_t vec_size;
+	__m256i *vec_data = (__m256i *)*data;
+	__m256i vec_const, vec_ror2;
+	union {
+		__m256i v;
+		jodyhash_t e[32 / sizeof(jodyhash_t)];
+	} ep1, ep2;
+	jodyhash_t qhash = *hash;
+
+	/* Constants preload */
+	vec_const = JH_MM256_SET1(constant);
+	vec_ror2  = JH_MM256_SET1(JH_ROR2(constant));
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 32); i++) {
+		ep1.v = _mm256_loadu_si256(&vec_data[i]);
+
+		/* "element2" gets RORed and XORed against the ROR2 constant */
+		ep2.v = _mm256_xor_si256(JH_MM256_ROR(ep1.v), vec_ror2);
+
+		/* Add the constant to "element" */
+		ep1.v = JH_MM256_ADD(ep1.v, vec_const);
+
+		/* Perform the rest of the hash */
+		for (size_t j = 0; j < 32 / sizeof(jodyhash_t); j++) {
+			qhash += ep1.e[j];
+			qhash ^= ep2.e[j];
+			qhash = JH_ROL2(qhash);
+			qhash += ep1.e[j];
+		}
+	}
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
 	*hash = qhash;
 	return 0;
 }
 
+#endif /* JODY_HASH_WIDTH == 64 */
 #endif /* NO_AVX2 */
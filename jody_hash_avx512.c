@@ -0,0 +1,226 @@
+/* Jody Bruchon's fast hashing function
+ *
+ * This function was written to generate a fast hash that also has a
+ * fairly low collision rate. The collision rate is much higher than
+ * a secure hash algorithm, but the calculation is drastically simpler
+ * and faster.
+ *
+ * Copyright (C) 2014-2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jody_hash.h"
+#include "jody_hash_simd.h"
+
+#ifndef NO_AVX512
+
+/* Some unmasked intrinsics trip -Wmaybe-uninitialized in some GCC
+ * versions; zero-masked versions with every lane enabled are identical */
+#define JH_ROR512(a, b) _mm512_maskz_ror_epi64((__mmask8)0xff, a, b)
+#define JH_ROL512(a, b) _mm512_maskz_rol_epi64((__mmask8)0xff, a, b)
+#define JH_INSERT512(a, b, c) _mm512_maskz_inserti64x4((__mmask8)0xff, a, b, c)
+
+/* constant is the hash constant to use, so seeded hashes need no rebuild */
+int jody_block_hash_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant)
+{
+	size_t vec_size;
+	__m512i *vec_data = (__m512i *)*data;
+	/* 1=ROR/XOR work, 3=data+constant */
+	__m512i vz1, vz3;
+	__m512i avx_const, avx_ror2;
+	union UINT512 ep1, ep2;
+	jodyhash_t qhash = *hash;
+
+	/* Constants preload */
+	avx_const = _mm512_set1_epi64((long long)constant);
+	avx_ror2  = _mm512_set1_epi64((long long)JH_ROR2(constant));
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffc0U;
+
+	for (size_t i = 0; i < (vec_size / 64); i++) {
+		vz3  = _mm512_loadu_si512(&vec_data[i]);
+
+		/* "element2" gets RORed (VPRORQ does it in one instruction) */
+		vz1  = JH_ROR512(vz3, JODY_HASH_SHIFT);
+		vz1  = _mm512_xor_si512(vz1, avx_ror2);  // XOR against the ROR2 constant
+
+		/* Add the constant to "element" */
+		vz3  = _mm512_add_epi64(vz3, avx_const);
+
+		/* Perform the rest of the hash */
+		_mm512_store_si512(&ep1.v512, vz3);
+		_mm512_store_si512(&ep2.v512, vz1);
+		for (int j = 0; j < 8; j++) {
+			qhash += ep1.v64[j];
+			qhash ^= ep2.v64[j];
+			qhash = JH_ROL2(qhash);
+			qhash += ep1.v64[j];
+		}  // End of hash finish loop
+	}  // End of main AVX-512 for loop
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	*hash = qhash;
+	return 0;
+}
+
+
+/* Striped hash: all eight lanes fit in one register and both rotates are
+ * single VPROLQ/VPRORQ instructions */
+int jody_striped_block_hash_avx512(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length)
+{
+	size_t vec_size;
+	__m512i *vec_data = (__m512i *)*data;
+	/* 1=ROR/XOR work, 3=data+constant; acc = lane hashes */
+	__m512i vz1, vz3;
+	__m512i acc;
+	__m512i avx_const, avx_ror2;
+
+	/* Constants preload */
+	avx_const = _mm512_load_si512(&vec_constant.v512);
+	avx_ror2  = _mm512_load_si512(&vec_constant_ror2.v512);
+
+	acc = _mm512_loadu_si512(lanes);
+
+	/* Only whole stripes of eight words are processed here */
+	vec_size = count & 0xffffffffffffffc0U;
+
+	for (size_t i = 0; i < (vec_size / 64); i++) {
+		vz3  = _mm512_loadu_si512(&vec_data[i]);
+
+		/* "element2" gets RORed and XORed against the ROR2 constant */
+		vz1  = JH_ROR512(vz3, JODY_HASH_SHIFT);
+		vz1  = _mm512_xor_si512(vz1, avx_ror2);
+
+		/* Add the constant to "element" */
+		vz3  = _mm512_add_epi64(vz3, avx_const);
+
+		/* Mix into the lane hashes: add, XOR, ROL2, add */
+		acc  = _mm512_add_epi64(acc, vz3);
+		acc  = _mm512_xor_si512(acc, vz1);
+		acc  = JH_ROL512(acc, JH_SHIFT2);
+		acc  = _mm512_add_epi64(acc, vz3);
+	}  // End of main AVX-512 for loop
+
+	_mm512_storeu_si512(lanes, acc);
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	return 0;
+}
+
+
+/* Multi-buffer hash: one buffer per 64-bit lane, eight buffers at a time.
+ * Each group of four buffers is transposed with AVX2 shuffles and the two
+ * halves are joined into one 512-bit register per word position. count
+ * must be a multiple of 32 and is hashed from all eight buffers. */
+int jody_block_hash_multi_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count)
+{
+	__m256i r[8], t0, t1, t2, t3;
+	__m512i w[4], vz1;
+	__m512i acc;
+	__m512i avx_const, avx_ror2;
+
+	/* Constants preload */
+	avx_const = _mm512_load_si512(&vec_constant.v512);
+	avx_ror2  = _mm512_load_si512(&vec_constant_ror2.v512);
+
+	acc = _mm512_loadu_si512(hash);
+
+	for (size_t i = 0; i < count / sizeof(jodyhash_t); i += 4) {
+		for (int j = 0; j < 8; j++) r[j] = _mm256_loadu_si256((__m256i *)(data[j] + i));
+
+		/* Two 4x4 transposes of 64-bit elements */
+		for (int j = 0; j < 8; j += 4) {
+			t0 = _mm256_unpacklo_epi64(r[j], r[j + 1]);
+			t1 = _mm256_unpackhi_epi64(r[j], r[j + 1]);
+			t2 = _mm256_unpacklo_epi64(r[j + 2], r[j + 3]);
+			t3 = _mm256_unpackhi_epi64(r[j + 2], r[j + 3]);
+			r[j]     = _mm256_permute2x128_si256(t0, t2, 0x20);
+			r[j + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+			r[j + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+			r[j + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+		}
+		for (int j = 0; j < 4; j++) w[j] = JH_INSERT512(_mm512_castsi256_si512(r[j]), r[j + 4], 1);
+
+		for (int j = 0; j < 4; j++) {
+			/* "element2" gets RORed and XORed against the ROR2 constant */
+			vz1  = JH_ROR512(w[j], JODY_HASH_SHIFT);
+			vz1  = _mm512_xor_si512(vz1, avx_ror2);
+
+			/* Add the constant to "element" */
+			w[j] = _mm512_add_epi64(w[j], avx_const);
+
+			/* Mix into all eight hashes: add, XOR, ROL2, add */
+			acc  = _mm512_add_epi64(acc, w[j]);
+			acc  = _mm512_xor_si512(acc, vz1);
+			acc  = JH_ROL512(acc, JH_SHIFT2);
+			acc  = _mm512_add_epi64(acc, w[j]);
+		}
+	}
+
+	_mm512_storeu_si512(hash, acc);
+	for (int j = 0; j < 8; j++) data[j] += count / sizeof(jodyhash_t);
+	return 0;
+}
+
+
+/* 128-bit variant: the element math for both chains is done eight words at
+ * a time and the two serial chains are then run side by side */
+int jody_block_hash128_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length)
+{
+	size_t vec_size;
+	__m512i *vec_data = (__m512i *)*data;
+	/* 1=ROR/XOR work, 3=data+constant; z=first chain, y=second */
+	__m512i vz1, vz3, vy1, vy3;
+	__m512i avx_const, avx_ror2, avx_const128, avx_ror2_128;
+	union UINT512 ep1, ep2, ep3, ep4;
+	jodyhash_t qhash1 = hash[0], qhash2 = hash[1];
+
+	/* Constants preload */
+	avx_const    = _mm512_load_si512(&vec_constant.v512);
+	avx_ror2     = _mm512_load_si512(&vec_constant_ror2.v512);
+	avx_const128 = _mm512_load_si512(&vec_constant128.v512);
+	avx_ror2_128 = _mm512_load_si512(&vec_constant128_ror2.v512);
+
+	vec_size = count & 0xffffffffffffffc0U;
+
+	for (size_t i = 0; i < (vec_size / 64); i++) {
+		vz3  = _mm512_loadu_si512(&vec_data[i]);
+
+		/* "element2" gets RORed by each chain's shift and XORed */
+		vz1  = JH_ROR512(vz3, JODY_HASH_SHIFT);
+		vy1  = JH_ROR512(vz3, JODY_HASH128_SHIFT);
+		vz1  = _mm512_xor_si512(vz1, avx_ror2);
+		vy1  = _mm512_xor_si512(vy1, avx_ror2_128);
+
+		/* Add each chain's constant to "element" */
+		vy3  = _mm512_add_epi64(vz3, avx_const128);
+		vz3  = _mm512_add_epi64(vz3, avx_const);
+
+		/* Perform the rest of the hash */
+		_mm512_store_si512(&ep1.v512, vz3);
+		_mm512_store_si512(&ep2.v512, vz1);
+		_mm512_store_si512(&ep3.v512, vy3);
+		_mm512_store_si512(&ep4.v512, vy1);
+		for (int j = 0; j < 8; j++) {
+			qhash1 += ep1.v64[j];
+			qhash2 += ep3.v64[j];
+			qhash1 ^= ep2.v64[j];
+			qhash2 ^= ep4.v64[j];
+			qhash1 = JH_ROL2(qhash1);
+			qhash2 = JH128_ROL2(qhash2);
+			qhash1 += ep1.v64[j];
+			qhash2 += ep3.v64[j];
+		}  // End of hash finish loop
+	}  // End of main AVX-512 for loop
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	hash[0] = qhash1;
+	hash[1] = qhash2;
+	return 0;
+}
+
+#endif /* NO_AVX512 */
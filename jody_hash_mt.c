@@ -0,0 +1,166 @@
+/* Jody Bruchon's fast hashing function (multithreaded rolling/tree hash)
+ *
+ * Every block of a ROLLING or tree hash is hashed on its own,
+ * so the blocks can be split between threads in any way and still
+ * produce the serial result.
+ *
+ * Copyright (C) 2014-2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <stdlib.h>
+#include "jody_hash.h"
+#include "likely_unlikely.h"
+
+#if defined _WIN32 || defined __WIN32 || defined ON_WINDOWS
+ #ifndef NO_THREADS
+  #define NO_THREADS
+ #endif
+#endif
+
+#ifndef NO_THREADS
+ #include <pthread.h>
+ #include <unistd.h>
+#endif
+
+/* Upper limit on worker threads for one hash */
+#ifndef JH_MT_MAX_THREADS
+ #define JH_MT_MAX_THREADS 64
+#endif
+/* Minimum rolling blocks per thread; smaller jobs aren't worth a thread */
+#ifndef JH_MT_MIN_BLOCKS
+ #define JH_MT_MIN_BLOCKS 256
+#endif
+
+/* Thread count; 0 = one per online CPU */
+static int jh_threads = 0;
+
+
+/* Set the number of threads for multithreaded hashing (0 = automatic) */
+extern int jody_hash_set_threads(const int threads)
+{
+	if (threads < 0) return 1;
+	jh_threads = threads;
+	return 0;
+}
+
+
+#ifndef NO_THREADS
+struct jh_mt_work {
+	jodyhash_t *data;
+	size_t count;
+	size_t bsize;
+	jodyhash_t *leaves;
+	jodyhash_t hash;
+	int status;
+};
+
+
+static void *jh_mt_worker(void *arg)
+{
+	struct jh_mt_work *work = (struct jh_mt_work *)arg;
+
+	work->hash = 0;
+	work->status = jody_rolling_block_hash_bs(work->data, &(work->hash), work->count, work->bsize);
+	return NULL;
+}
+
+
+static void *jh_mt_tree_worker(void *arg)
+{
+	struct jh_mt_work *work = (struct jh_mt_work *)arg;
+
+	work->hash = 0;
+	work->status = jody_tree_leaves(work->data, work->count, work->leaves);
+	return NULL;
+}
+
+
+/* How many threads should hash this many blocks? */
+static size_t jh_mt_thread_count(const size_t blocks)
+{
+	long cpus;
+	size_t threads;
+
+	if (jh_threads > 0) threads = (size_t)jh_threads;
+	else {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (size_t)cpus : 1;
+	}
+	if (threads > JH_MT_MAX_THREADS) threads = JH_MT_MAX_THREADS;
+	if (threads > blocks / JH_MT_MIN_BLOCKS) threads = blocks / JH_MT_MIN_BLOCKS;
+	return threads;
+}
+
+
+/* Split a buffer into runs of whole bsize blocks that are hashed by worker
+ * threads. The calling thread hashes the last run (which includes any
+ * partial block). Per-run hashes are XORed into *hash. */
+static int jh_mt_run(void *(*worker)(void *), jodyhash_t *data, const size_t count, const size_t bsize, jodyhash_t *leaves, jodyhash_t *hash, const size_t threads)
+{
+	pthread_t tid[JH_MT_MAX_THREADS];
+	struct jh_mt_work work[JH_MT_MAX_THREADS];
+	size_t per_thread, started, i;
+	int retval = 0;
+
+	per_thread = (count / bsize) / threads;
+	for (started = 0; started < threads - 1; started++) {
+		i = started * per_thread;
+		work[started].data = data + (i * (bsize / sizeof(jodyhash_t)));
+		work[started].count = per_thread * bsize;
+		work[started].bsize = bsize;
+		work[started].leaves = leaves != NULL ? leaves + i : NULL;
+		if (pthread_create(&tid[started], NULL, worker, &work[started]) != 0) break;
+	}
+
+	/* Whatever wasn't handed to a thread is hashed here */
+	i = started * per_thread;
+	work[started].data = data + (i * (bsize / sizeof(jodyhash_t)));
+	work[started].count = count - (i * bsize);
+	work[started].bsize = bsize;
+	work[started].leaves = leaves != NULL ? leaves + i : NULL;
+	worker(&work[started]);
+
+	for (i = 0; i < started; i++) pthread_join(tid[i], NULL);
+	for (i = 0; i <= started; i++) {
+		if (work[i].status != 0) retval = 1;
+		*hash ^= work[i].hash;
+	}
+	return retval;
+}
+#endif /* NO_THREADS */
+
+
+/* Same result as jody_rolling_block_hash_bs(), but large buffers are
+ * split between threads */
+extern int jody_rolling_block_hash_mt_bs(jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t bsize)
+{
+#ifndef NO_THREADS
+	size_t threads;
+
+	if (unlikely(!JH_ROLL_BSIZE_VALID(bsize))) return 1;
+	threads = jh_mt_thread_count(count / bsize);
+	if (threads >= 2) return jh_mt_run(jh_mt_worker, data, count, bsize, NULL, hash, threads);
+#endif /* NO_THREADS */
+	return jody_rolling_block_hash_bs(data, hash, count, bsize);
+}
+
+
+extern int jody_rolling_block_hash_mt(jodyhash_t *data, jodyhash_t *hash, const size_t count)
+{
+	return jody_rolling_block_hash_mt_bs(data, hash, count, ROLLBSIZE);
+}
+
+
+/* Same result as jody_tree_leaves(), but large buffers are split between
+ * threads; each thread fills in its own range of leaves */
+extern int jody_tree_leaves_mt(jodyhash_t *data, const size_t count, jodyhash_t *leaves)
+{
+#ifndef NO_THREADS
+	size_t threads = jh_mt_thread_count(count / ROLLBSIZE);
+	jodyhash_t unused = 0;
+
+	if (threads >= 2) return jh_mt_run(jh_mt_tree_worker, data, count, ROLLBSIZE, leaves, &unused, threads);
+#endif /* NO_THREADS */
+	return jody_tree_leaves(data, count, leaves);
+}
@@ -13,15 +13,43 @@
 #include "jody_hash.h"
 #include "jody_hash_simd.h"
 
-#if (!defined NO_SSE2 || !defined NO_AVX2)
-const union UINT256 vec_constant = {
+#if (!defined NO_SSE2 || !defined NO_AVX2 || !defined NO_AVX512)
+const union UINT512 vec_constant = {
 	.v64[0] = JODY_HASH_CONSTANT,
 	.v64[1] = JODY_HASH_CONSTANT,
 	.v64[2] = JODY_HASH_CONSTANT,
-	.v64[3] = JODY_HASH_CONSTANT };
-const union UINT256 vec_constant_ror2 = {
+	.v64[3] = JODY_HASH_CONSTANT,
+	.v64[4] = JODY_HASH_CONSTANT,
+	.v64[5] = JODY_HASH_CONSTANT,
+	.v64[6] = JODY_HASH_CONSTANT,
+	.v64[7] = JODY_HASH_CONSTANT };
+const union UINT512 vec_constant_ror2 = {
 	.v64[0] = JODY_HASH_CONSTANT_ROR2,
 	.v64[1] = JODY_HASH_CONSTANT_ROR2,
 	.v64[2] = JODY_HASH_CONSTANT_ROR2,
-	.v64[3] = JODY_HASH_CONSTANT_ROR2 };
+	.v64[3] = JODY_HASH_CONSTANT_ROR2,
+	.v64[4] = JODY_HASH_CONSTANT_ROR2,
+	.v64[5] = JODY_HASH_CONSTANT_ROR2,
+	.v64[6] = JODY_HASH_CONSTANT_ROR2,
+	.v64[7] = JODY_HASH_CONSTANT_ROR2 };
+#if JODY_HASH_WIDTH == 64
+const union UINT512 vec_constant128 = {
+	.v64[0] = JODY_HASH128_CONSTANT,
+	.v64[1] = JODY_HASH128_CONSTANT,
+	.v64[2] = JODY_HASH128_CONSTANT,
+	.v64[3] = JODY_HASH128_CONSTANT,
+	.v64[4] = JODY_HASH128_CONSTANT,
+	.v64[5] = JODY_HASH128_CONSTANT,
+	.v64[6] = JODY_HASH128_CONSTANT,
+	.v64[7] = JODY_HASH128_CONSTANT };
+const union UINT512 vec_constant128_ror2 = {
+	.v64[0] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[1] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[2] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[3] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[4] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[5] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[6] = JODY_HASH128_CONSTANT_ROR2,
+	.v64[7] = JODY_HASH128_CONSTANT_ROR2 };
+#endif /* JODY_HASH_WIDTH == 64 */
 #endif
@@ -10,14 +10,22 @@ extern "C" {
 
 #include "jody_hash.h"
 
-/* Disable SIMD if not 64-bit width or not 64-bit x86 code */
-#if JODY_HASH_WIDTH != 64 || !defined __x86_64__ || SIZE_MAX == 0xffffffff || (defined NO_SSE2 && defined NO_AVX2)
+/* The 32-bit and 16-bit widths only have SSE2 and AVX2 block kernels */
+#if JODY_HASH_WIDTH != 64 && !defined NO_AVX512
+ #define NO_AVX512
+#endif
+
+/* Disable SIMD if not 64-bit x86 code */
+#if !defined __x86_64__ || SIZE_MAX == 0xffffffff || (defined NO_SSE2 && defined NO_AVX2 && defined NO_AVX512)
  #ifndef NO_SSE2
   #define NO_SSE2
  #endif
  #ifndef NO_AVX2
   #define NO_AVX2
  #endif
+ #ifndef NO_AVX512
+  #define NO_AVX512
+ #endif
  #ifndef NO_SIMD
   #define NO_SIMD
  #endif
@@ -25,35 +33,59 @@ extern "C" {
 
 /* Use SIMD by default */
 #if !defined NO_SIMD
- #if defined __APPLE__
-  /* Mac OS X < 10.15 don't support aligned_alloc */
-  #include <x86intrin.h>
-  #define aligned_alloc(a,b) malloc(b)
-  #define ALIGNED_FREE(a) free(a)
- #elif defined _MSC_VER || defined _WIN32 || defined __MINGW32__
+ #if defined _MSC_VER
   /* Microsoft C/C++-compatible compiler */
   #include <intrin.h>
-  #define aligned_alloc(a,b) _aligned_malloc(b,a)
-  #define ALIGNED_FREE(a) _aligned_free(a)
  #elif (defined __GNUC__  || defined __clang__ ) && (defined __x86_64__  || defined __i386__ )
   /* GCC or Clang targeting x86/x86-64 */
   #include <x86intrin.h>
-  #define ALIGNED_FREE(a) free(a)
  #endif
 #endif /* !NO_SIMD */
 
-#if !defined NO_SSE2 || !defined NO_AVX2
-union UINT256 {
-	__m256i  v256;
-	__m128i  v128[2];
-	uint64_t v64[4];
+/* Element-wise vector ops for the 32-bit and 16-bit widths */
+#if JODY_HASH_WIDTH == 32
+ #define JH_MM_SET1(a)      _mm_set1_epi32((int)(a))
+ #define JH_MM_ADD(a, b)    _mm_add_epi32((a), (b))
+ #define JH_MM_ROR(a)       _mm_or_si128(_mm_srli_epi32((a), JODY_HASH_SHIFT), _mm_slli_epi32((a), (32 - JODY_HASH_SHIFT)))
+ #define JH_MM256_SET1(a)   _mm256_set1_epi32((int)(a))
+ #define JH_MM256_ADD(a, b) _mm256_add_epi32((a), (b))
+ #define JH_MM256_ROR(a)    _mm256_or_si256(_mm256_srli_epi32((a), JODY_HASH_SHIFT), _mm256_slli_epi32((a), (32 - JODY_HASH_SHIFT)))
+#elif JODY_HASH_WIDTH == 16
+ #define JH_MM_SET1(a)      _mm_set1_epi16((short)(a))
+ #define JH_MM_ADD(a, b)    _mm_add_epi16((a), (b))
+ #define JH_MM_ROR(a)       _mm_or_si128(_mm_srli_epi16((a), JODY_HASH_SHIFT), _mm_slli_epi16((a), (16 - JODY_HASH_SHIFT)))
+ #define JH_MM256_SET1(a)   _mm256_set1_epi16((short)(a))
+ #define JH_MM256_ADD(a, b) _mm256_add_epi16((a), (b))
+ #define JH_MM256_ROR(a)    _mm256_or_si256(_mm256_srli_epi16((a), JODY_HASH_SHIFT), _mm256_slli_epi16((a), (16 - JODY_HASH_SHIFT)))
+#endif
+
+#if !defined NO_SSE2 || !defined NO_AVX2 || !defined NO_AVX512
+union UINT512 {
+#ifndef NO_AVX512
+	__m512i  v512;
+#endif
+	__m256i  v256[2];
+	__m128i  v128[4];
+	uint64_t v64[8];
 };
 
-extern const union UINT256 vec_constant, vec_constant_ror2;
+extern const union UINT512 vec_constant, vec_constant_ror2;
+extern const union UINT512 vec_constant128, vec_constant128_ror2;
 #endif
 
-extern int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length);
-extern int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length);
+extern int jody_block_hash_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant);
+extern int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant);
+extern int jody_striped_block_hash_avx2(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length);
+extern int jody_striped_block_hash_sse2(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length);
+extern int jody_block_hash_multi_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count);
+extern int jody_block_hash_multi_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count);
+extern int jody_block_hash_multi_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count);
+extern int jody_block_hash_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant);
+extern int jody_block_hash_cmp_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, size_t *mismatch);
+extern int jody_block_hash_cmp_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, size_t *mismatch);
+extern int jody_block_hash128_avx2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length);
+extern int jody_block_hash128_avx512(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length);
+extern int jody_striped_block_hash_avx512(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length);
 
 #ifdef __cplusplus
 }
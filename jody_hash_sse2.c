@@ -16,52 +16,37 @@
 #include "jody_hash_simd.h"
 
 #ifndef NO_SSE2
+#if JODY_HASH_WIDTH == 64
 
-int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length)
+/* constant is the hash constant to use, so seeded hashes need no rebuild */
+int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant)
 {
-	size_t vec_allocsize;
-	__m128i *aligned_data;
+	size_t vec_size;
+	__m128i *vec_data = (__m128i *)*data;
 	__m128i v1, v2, v3, v4, v5, v6;
 	__m128 vzero;
 	__m128i vec_const, vec_ror2;
 	jodyhash_t qhash = *hash;
 
-#if defined __GNUC__ || defined __clang__
-	__builtin_cpu_init ();
-	if (__builtin_cpu_supports ("avx")) {
-		asm volatile ("vzeroall" : : :
-			"ymm0", "ymm1", "ymm2", "ymm3", "ymm4", "ymm5", "ymm6", "ymm7",
-			"ymm8", "ymm9", "ymm10", "ymm11", "ymm12", "ymm13", "ymm14", "ymm15");
-	}
-#endif /* __GNUC__ || __clang__ */
-
 	/* Constants preload */
-	vec_const = _mm_load_si128(&vec_constant.v128[0]);
-	vec_ror2  = _mm_load_si128(&vec_constant_ror2.v128[0]);
+	vec_const = _mm_set1_epi64x((long long)constant);
+	vec_ror2  = _mm_set1_epi64x((long long)JH_ROR2(constant));
 	vzero = _mm_setzero_ps();
 
-	/* How much memory do we need to align the data? */
-	vec_allocsize = count & 0xffffffffffffffe0U;
-	/* Only alloc/copy if not already aligned */
-	if (((uintptr_t)*data & (uintptr_t)0x0fULL) != 0) {
-		aligned_data  = (__m128i *)aligned_alloc(16, vec_allocsize);
-		if (!aligned_data) return 1;
-		memcpy(aligned_data, *data, vec_allocsize);
-	} else aligned_data = (__m128i *)*data;
-
-	for (size_t i = 0; i < (vec_allocsize / 16); i++) {
-		v1  = _mm_load_si128(&aligned_data[i]);
-		v3  = _mm_load_si128(&aligned_data[i]);
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 16); i++) {
+		v3  = _mm_loadu_si128(&vec_data[i]);
 		i++;
-		v4  = _mm_load_si128(&aligned_data[i]);
-		v6  = _mm_load_si128(&aligned_data[i]);
+		v6  = _mm_loadu_si128(&vec_data[i]);
 
 		/* "element2" gets RORed (two logical shifts ORed together) */
-		v1  = _mm_srli_epi64(v1, JODY_HASH_SHIFT);
+		v1  = _mm_srli_epi64(v3, JODY_HASH_SHIFT);
 		v2  = _mm_slli_epi64(v3, (64 - JODY_HASH_SHIFT));
 		v1  = _mm_or_si128(v1, v2);
 		v1  = _mm_xor_si128(v1, vec_ror2);  // XOR against the ROR2 constant
-		v4  = _mm_srli_epi64(v4, JODY_HASH_SHIFT);
+		v4  = _mm_srli_epi64(v6, JODY_HASH_SHIFT);
 		v5  = _mm_slli_epi64(v6, (64 - JODY_HASH_SHIFT));
 		v4  = _mm_or_si128(v4, v5);
 		v4  = _mm_xor_si128(v4, vec_ror2);  // XOR against the ROR2 constant
@@ -105,11 +90,234 @@ int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count
 			qhash += ep1;
 			}  // End of hash finish loop
 		}  // End of main SSE for loop
-	*data += vec_allocsize / sizeof(jodyhash_t);
-	if (((uintptr_t)*data & (uintptr_t)0x0fULL) != 0) ALIGNED_FREE(aligned_data);
-	*length = (count - vec_allocsize) / sizeof(jodyhash_t);
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	*hash = qhash;
+	return 0;
+}
+
+
+/* Hash two buffers and compare them in the same pass. The hash chains
+ * for the two buffers are independent, so they are interleaved. *mismatch
+ * is set to the offset of the first differing byte if it is still count. */
+int jody_block_hash_cmp_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, size_t *mismatch)
+{
+	size_t vec_size;
+	__m128i *vec_a = (__m128i *)data[0];
+	__m128i *vec_b = (__m128i *)data[1];
+	__m128i v1, v2, va, vb;
+	__m128i vec_const, vec_ror2;
+	union {
+		__m128i v[2];
+		uint64_t e[4];
+	} ea1, ea2, eb1, eb2;
+	jodyhash_t ha = hash[0], hb = hash[1];
+	const unsigned char *ca, *cb;
+	unsigned int eq;
+	int found = *mismatch != count;
+
+	/* Constants preload */
+	vec_const = _mm_load_si128(&vec_constant.v128[0]);
+	vec_ror2  = _mm_load_si128(&vec_constant_ror2.v128[0]);
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 16); i += 2) {
+		for (int k = 0; k < 2; k++) {
+			va = _mm_loadu_si128(&vec_a[i + (size_t)k]);
+			vb = _mm_loadu_si128(&vec_b[i + (size_t)k]);
+
+			/* Compare while the data is in registers */
+			if (!found) {
+				eq = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+				if (eq != 0xffffU) {
+					ca = (const unsigned char *)&vec_a[i + (size_t)k];
+					cb = (const unsigned char *)&vec_b[i + (size_t)k];
+					for (eq = 0; ca[eq] == cb[eq]; eq++);
+					*mismatch = ((i + (size_t)k) * 16) + eq;
+					found = 1;
+				}
+			}
+
+			/* "element2" gets RORed (two logical shifts ORed together) */
+			v1 = _mm_srli_epi64(va, JODY_HASH_SHIFT);
+			v2 = _mm_slli_epi64(va, (64 - JODY_HASH_SHIFT));
+			v1 = _mm_or_si128(v1, v2);
+			ea2.v[k] = _mm_xor_si128(v1, vec_ror2);  // XOR against the ROR2 constant
+			v1 = _mm_srli_epi64(vb, JODY_HASH_SHIFT);
+			v2 = _mm_slli_epi64(vb, (64 - JODY_HASH_SHIFT));
+			v1 = _mm_or_si128(v1, v2);
+			eb2.v[k] = _mm_xor_si128(v1, vec_ror2);  // XOR against the ROR2 constant
+
+			/* Add the constant to "element" */
+			ea1.v[k] = _mm_add_epi64(va, vec_const);
+			eb1.v[k] = _mm_add_epi64(vb, vec_const);
+		}
+
+		/* Perform the rest of both hashes */
+		for (int j = 0; j < 4; j++) {
+			ha += ea1.e[j];
+			hb += eb1.e[j];
+			ha ^= ea2.e[j];
+			hb ^= eb2.e[j];
+			ha = JH_ROL2(ha);
+			hb = JH_ROL2(hb);
+			ha += ea1.e[j];
+			hb += eb1.e[j];
+		}  // End of hash finish loop
+	}  // End of main SSE for loop
+	data[0] += vec_size / sizeof(jodyhash_t);
+	data[1] += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	hash[0] = ha;
+	hash[1] = hb;
+	return 0;
+}
+
+
+/* Striped hash: every 64-bit lane is an independent hash, so the mixing
+ * step runs entirely in vector registers. Four registers give the same
+ * eight lanes that the AVX2 version uses. */
+int jody_striped_block_hash_sse2(jodyhash_t **data, jodyhash_t *lanes, const size_t count, size_t *length)
+{
+	size_t vec_size;
+	__m128i *vec_data = (__m128i *)*data;
+	__m128i v1, v2, v3;
+	__m128i acc[4];
+	__m128i vec_const, vec_ror2;
+
+	/* Constants preload */
+	vec_const = _mm_load_si128(&vec_constant.v128[0]);
+	vec_ror2  = _mm_load_si128(&vec_constant_ror2.v128[0]);
+
+	for (int j = 0; j < 4; j++) acc[j] = _mm_loadu_si128((__m128i *)(lanes + (j * 2)));
+
+	/* Only whole stripes of eight words are processed here */
+	vec_size = count & 0xffffffffffffffc0U;
+
+	for (size_t i = 0; i < (vec_size / 16); i += 4) {
+		/* The compiler unrolls this; each register is an independent chain */
+		for (int j = 0; j < 4; j++) {
+			v3 = _mm_loadu_si128(&vec_data[i + (size_t)j]);
+
+			/* "element2" gets RORed (two logical shifts ORed together) */
+			v1 = _mm_srli_epi64(v3, JODY_HASH_SHIFT);
+			v2 = _mm_slli_epi64(v3, (64 - JODY_HASH_SHIFT));
+			v1 = _mm_or_si128(v1, v2);
+			v1 = _mm_xor_si128(v1, vec_ror2);  // XOR against the ROR2 constant
+
+			/* Add the constant to "element" */
+			v3 = _mm_add_epi64(v3, vec_const);
+
+			/* Mix into the lane hashes: add, XOR, ROL2, add */
+			acc[j] = _mm_add_epi64(acc[j], v3);
+			acc[j] = _mm_xor_si128(acc[j], v1);
+			v2     = _mm_slli_epi64(acc[j], JH_SHIFT2);
+			acc[j] = _mm_srli_epi64(acc[j], (64 - JH_SHIFT2));
+			acc[j] = _mm_or_si128(acc[j], v2);
+			acc[j] = _mm_add_epi64(acc[j], v3);
+		}
+	}  // End of main SSE for loop
+
+	for (int j = 0; j < 4; j++) _mm_storeu_si128((__m128i *)(lanes + (j * 2)), acc[j]);
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
+	return 0;
+}
+
+
+/* Multi-buffer hash: one buffer per 64-bit lane, two buffers at a time.
+ * count must be a multiple of 32 and is hashed from both buffers. */
+int jody_block_hash_multi_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count)
+{
+	__m128i r0, r1, w[2], v1, v2;
+	__m128i acc;
+	__m128i vec_const, vec_ror2;
+
+	/* Constants preload */
+	vec_const = _mm_load_si128(&vec_constant.v128[0]);
+	vec_ror2  = _mm_load_si128(&vec_constant_ror2.v128[0]);
+
+	acc = _mm_loadu_si128((__m128i *)hash);
+
+	for (size_t i = 0; i < count / sizeof(jodyhash_t); i += 2) {
+		r0 = _mm_loadu_si128((__m128i *)(data[0] + i));
+		r1 = _mm_loadu_si128((__m128i *)(data[1] + i));
+
+		/* 2x2 transpose of 64-bit elements */
+		w[0] = _mm_unpacklo_epi64(r0, r1);
+		w[1] = _mm_unpackhi_epi64(r0, r1);
+
+		for (int j = 0; j < 2; j++) {
+			/* "element2" gets RORed (two logical shifts ORed together) */
+			v1 = _mm_srli_epi64(w[j], JODY_HASH_SHIFT);
+			v2 = _mm_slli_epi64(w[j], (64 - JODY_HASH_SHIFT));
+			v1 = _mm_or_si128(v1, v2);
+			v1 = _mm_xor_si128(v1, vec_ror2);  // XOR against the ROR2 constant
+
+			/* Add the constant to "element" */
+			w[j] = _mm_add_epi64(w[j], vec_const);
+
+			/* Mix into both hashes: add, XOR, ROL2, add */
+			acc = _mm_add_epi64(acc, w[j]);
+			acc = _mm_xor_si128(acc, v1);
+			v2  = _mm_slli_epi64(acc, JH_SHIFT2);
+			acc = _mm_srli_epi64(acc, (64 - JH_SHIFT2));
+			acc = _mm_or_si128(acc, v2);
+			acc = _mm_add_epi64(acc, w[j]);
+		}
+	}
+
+	_mm_storeu_si128((__m128i *)hash, acc);
+	for (int j = 0; j < 2; j++) data[j] += count / sizeof(jodyhash_t);
+	return 0;
+}
+
+#else /* JODY_HASH_WIDTH != 64 */
+
+/* 32-bit and 16-bit widths: a vector of elements is loaded, RORed and
+ * offset at once, then mixed into the hash in order like the scalar code */
+int jody_block_hash_sse2(jodyhash_t **data, jodyhash_t *hash, const size_t count, size_t *length, const jodyhash_t constant)
+{
+	size_t vec_size;
+	__m128i *vec_data = (__m128i *)*data;
+	__m128i vec_const, vec_ror2;
+	union {
+		__m128i v;
+		jodyhash_t e[16 / sizeof(jodyhash_t)];
+	} ep1, ep2;
+	jodyhash_t qhash = *hash;
+
+	/* Constants preload */
+	vec_const = JH_MM_SET1(constant);
+	vec_ror2  = JH_MM_SET1(JH_ROR2(constant));
+
+	/* Unaligned loads are used so the data never needs to be copied */
+	vec_size = count & 0xffffffffffffffe0U;
+
+	for (size_t i = 0; i < (vec_size / 16); i++) {
+		ep1.v = _mm_loadu_si128(&vec_data[i]);
+
+		/* "element2" gets RORed and XORed against the ROR2 constant */
+		ep2.v = _mm_xor_si128(JH_MM_ROR(ep1.v), vec_ror2);
+
+		/* Add the constant to "element" */
+		ep1.v = JH_MM_ADD(ep1.v, vec_const);
+
+		/* Perform the rest of the hash */
+		for (size_t j = 0; j < 16 / sizeof(jodyhash_t); j++) {
+			qhash += ep1.e[j];
+			qhash ^= ep2.e[j];
+			qhash = JH_ROL2(qhash);
+			qhash += ep1.e[j];
+		}
+	}
+	*data += vec_size / sizeof(jodyhash_t);
+	*length = (count - vec_size) / sizeof(jodyhash_t);
 	*hash = qhash;
 	return 0;
 }
 
+#endif /* JODY_HASH_WIDTH == 64 */
 #endif /* NO_SSE2 */
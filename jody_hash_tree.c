@@ -0,0 +1,84 @@
+/* Jody Bruchon's fast hashing function (tree/Merkle hash)
+ *
+ * Data is split into ROLLBSIZE leaf blocks, each hashed on its own from
+ * zero with the normal jody_hash (so the leaves XORed together are the
+ * ROLLING hash). Pairs of nodes are then hashed together up to a single
+ * root; an odd node at the end of a level moves up a level unchanged.
+ * Any aligned power-of-two run of leaves is a complete subtree, so parts
+ * of the tree can be built separately and joined with jody_tree_combine().
+ *
+ * Copyright (C) 2014-2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <stdlib.h>
+#include "jody_hash.h"
+#include "likely_unlikely.h"
+
+/* Starting hash for interior nodes so they never match a leaf hash */
+#define JH_TREE_NODE_INIT JODY_HASH_CONSTANT
+
+
+/* Hash all leaf blocks of a buffer into leaves[JH_TREE_LEAVES(count)].
+ * Leaves are hashed in groups through the multi-buffer SIMD code. */
+extern int jody_tree_leaves(jodyhash_t *data, const size_t count, jodyhash_t *leaves)
+{
+	jodyhash_t *bdata[JH_MULTI_BATCH];
+	size_t bcount[JH_MULTI_BATCH];
+	size_t n = JH_TREE_LEAVES(count);
+	size_t batch, i, j, left;
+
+	for (i = 0; i < n; i += batch) {
+		batch = n - i;
+		if (batch > JH_MULTI_BATCH) batch = JH_MULTI_BATCH;
+		for (j = 0; j < batch; j++) {
+			left = count - ((i + j) * ROLLBSIZE);
+			bdata[j] = data + ((i + j) * ROLLBSIZEW);
+			bcount[j] = left > ROLLBSIZE ? ROLLBSIZE : left;
+			leaves[i + j] = 0;
+		}
+		if (jody_block_hash_multi(bdata, leaves + i, bcount, batch) != 0) return 1;
+	}
+	return 0;
+}
+
+
+/* Parent node of two subtrees */
+extern jodyhash_t jody_tree_combine(const jodyhash_t left, const jodyhash_t right)
+{
+	jodyhash_t node[2];
+	jodyhash_t hash = JH_TREE_NODE_INIT;
+
+	node[0] = left;
+	node[1] = right;
+	jody_block_hash(node, &hash, sizeof(node));
+	return hash;
+}
+
+
+/* Merkle root of n leaves (zero if there are none). Complete subtrees are
+ * merged as soon as they exist, so only one node per level is kept. */
+extern jodyhash_t jody_tree_root(const jodyhash_t *leaves, const size_t n)
+{
+	jodyhash_t stack[sizeof(size_t) * 8 + 1];
+	unsigned int level[sizeof(size_t) * 8 + 1];
+	unsigned int top = 0;
+	jodyhash_t root;
+
+	if (n == 0) return 0;
+	for (size_t i = 0; i < n; i++) {
+		stack[top] = leaves[i];
+		level[top] = 0;
+		top++;
+		while (top > 1 && level[top - 1] == level[top - 2]) {
+			stack[top - 2] = jody_tree_combine(stack[top - 2], stack[top - 1]);
+			level[top - 2]++;
+			top--;
+		}
+	}
+
+	/* Partial subtrees at the end join their left neighbors */
+	root = stack[--top];
+	while (top > 0) root = jody_tree_combine(stack[--top], root);
+	return root;
+}
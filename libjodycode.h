@@ -11,6 +11,13 @@
 extern "C" {
 #endif
 
+/* restrict is C99 only; C++ compilers spell it __restrict */
+#ifdef __cplusplus
+ #define JC_RESTRICT __restrict
+#else
+ #define JC_RESTRICT restrict
+#endif
+
 /* libjodycode version information
  * The major/minor version number and API version/revision MUST match!
  * Major version must change whenever an interface incompatibly changes
@@ -22,9 +29,9 @@ extern "C" {
  * supports the used interfaces should be chosen by programs that check
  * version information for compatibility. See README for more information. */
 #define LIBJODYCODE_API_VERSION       4
-#define LIBJODYCODE_API_FEATURE_LEVEL 4
-#define LIBJODYCODE_VER               "4.0"
-#define LIBJODYCODE_VERDATE           "2024-02-09"
+#define LIBJODYCODE_API_FEATURE_LEVEL 5
+#define LIBJODYCODE_VER               "4.1"
+#define LIBJODYCODE_VERDATE           "2026-10-17"
 #ifdef UNICODE
  #define LIBJODYCODE_WINDOWS_UNICODE  1
 #else
@@ -46,6 +53,7 @@ extern "C" {
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #ifdef UNICODE
@@ -198,7 +206,7 @@ struct JC_STAT {
  #define JC_W_OK W_OK
  #define JC_X_OK X_OK
 #endif /* Windows */
-extern int jc_stat(const char * const filename, struct JC_STAT * const restrict buf);
+extern int jc_stat(const char * const filename, struct JC_STAT * const JC_RESTRICT buf);
 
 
 /*** dir ***/
@@ -260,7 +268,7 @@ typedef struct _JC_DIR_T {
  #endif /* DT_UNKNOWN */
 #endif /* ON_WINDOWS */
 extern int jc_closedir(JC_DIR *dirp);
-extern JC_DIR *jc_opendir(const char * restrict path);
+extern JC_DIR *jc_opendir(const char * JC_RESTRICT path);
 extern JC_DIRENT *jc_readdir(JC_DIR *dirp);
 
 
@@ -297,6 +305,33 @@ extern struct jc_fileinfo_batch *jc_fileinfo_batch_alloc(const int filecnt, int
 extern void jc_fileinfo_batch_free(struct jc_fileinfo_batch *batch);
 
 
+/*** pool ***/
+
+/* Per-thread pool of reusable aligned buffers. Sizes are rounded up to a
+ * power of two; buffers of JC_POOL_HUGE bytes or more are huge page
+ * aligned and use transparent huge pages where available.
+ * jc_hash_file(), jc_hash_fd(), jc_hash_batch() and jc_copy_hash() take
+ * their buffers from the calling thread's pool, so a thread that used
+ * them keeps up to 4 MiB until it exits; call jc_pool_trim() to free it
+ * sooner. */
+#define JC_POOL_ALIGN 4096
+#define JC_POOL_HUGE  2097152
+
+struct jc_pool_stats {
+	uint64_t gets;          /* jc_pool_get() calls */
+	uint64_t hits;          /* leases served from the pool */
+	size_t leased;          /* bytes leased and not yet returned */
+	size_t leased_max;      /* high-water mark of leased bytes */
+	size_t cached;          /* bytes kept for reuse */
+	size_t cached_max;      /* high-water mark of cached bytes */
+};
+
+extern void *jc_pool_get(const size_t size);
+extern void jc_pool_put(void *buf, const size_t size);
+extern void jc_pool_trim(void);
+extern int jc_pool_get_stats(struct jc_pool_stats * const JC_RESTRICT stats);
+
+
 /*** cacheinfo ***/
 
 /* Don't use cacheinfo on anything but Linux for now */
@@ -348,7 +383,7 @@ extern int jc_print_error(int errnum);
 
 
 /*** jc_fwprint ***/
-extern int jc_fwprint(FILE * const restrict stream, const char * const restrict str, const int cr);
+extern int jc_fwprint(FILE * const JC_RESTRICT stream, const char * const JC_RESTRICT str, const int cr);
 
 
 /*** jody_hash ***/
@@ -357,14 +392,223 @@ extern int jc_fwprint(FILE * const restrict stream, const char * const restrict
 #ifndef JODY_HASH_VERSION
  #define JODY_HASH_VERSION 7
 #endif
+#ifndef JODY_HASH_STRIPED_VERSION
+ #define JODY_HASH_STRIPED_VERSION 1
+#endif
+#ifndef JODY_HASH128_VERSION
+ #define JODY_HASH128_VERSION 1
+#endif
 
 /* Width of a jody_hash */
 #define JODY_HASH_WIDTH 64
 typedef uint64_t jodyhash_t;
 
-enum jc_e_hash { NORMAL, ROLLING };
+/* NORMAL: standard jody_hash; chained blocks must be sized in whole jodyhash_t words
+ * ROLLING: XOR of the NORMAL hashes of each 4 KiB block
+ * ROLLING_MT: same result as ROLLING; large buffers are split across threads
+ * STRIPED: eight independent lanes folded at the end; much faster with SIMD
+ *          but results differ from NORMAL and depend on the block boundaries
+ * NORMAL128: 128-bit hash; hash must point to two jodyhash_t, the first of
+ *            which is the NORMAL hash. Chained the same way as NORMAL.
+ * CRC32C: standard CRC-32C (hardware accelerated) in the low 32 bits;
+ *         blocks of any size can be chained
+ * SEEDED: NORMAL keyed with a per-process key (see jc_set_hash_seed) so
+ *         hash tables can't be flooded with crafted collisions
+ * Hash types can also be looked up by name with jc_get_hash_type() */
+enum jc_e_hash { NORMAL, ROLLING, STRIPED, ROLLING_MT, NORMAL128, CRC32C, SEEDED };
+#define JC_HASH_TYPES 7
+
+/* SIMD code used by jc_block_hash(); picked once at startup by default.
+ * Forcing a kernel is useful for benchmarking or pinning a known-good one. */
+enum jc_e_hash_kernel { HASH_KERNEL_AUTO, HASH_KERNEL_SCALAR, HASH_KERNEL_SSE2, HASH_KERNEL_AVX2, HASH_KERNEL_AVX512 };
+
+/* One buffer for jc_block_hash_multi(); hash is the starting value on
+ * input and the result on output, exactly like jc_block_hash() */
+struct jc_hash_job {
+	jodyhash_t *data;
+	size_t count;
+	jodyhash_t hash;
+};
+
+/* Streaming hash state for jc_hash_init/update/final (all types except
+ * STRIPED).
+ * Data may be fed in any sizes; the result matches jc_block_hash(). */
+struct jc_hash_ctx {
+	enum jc_e_hash type;
+	jodyhash_t hash[2];     /* running hash (ROLLING: XOR of finished blocks);
+	                           hash[1] is only used by NORMAL128 */
+	jodyhash_t block_hash;  /* ROLLING: hash of the current block */
+	size_t block_pos;       /* ROLLING: bytes fed into the current block */
+	size_t block_size;      /* ROLLING: block size (see jc_hash_set_block_size) */
+	jodyhash_t partial;     /* bytes not yet making up a whole word */
+	size_t partial_len;
+	uint64_t total;         /* bytes fed in so far */
+};
 
 extern int jc_block_hash(enum jc_e_hash type, jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jc_block_hash_normal(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jc_block_hash_rolling(jodyhash_t *data, jodyhash_t *hash, const size_t count);
+extern int jc_block_hash_multi(enum jc_e_hash type, struct jc_hash_job *jobs, const size_t cnt);
+extern int jc_block_hash_cmp(jodyhash_t *data1, jodyhash_t *data2, jodyhash_t *hash1, jodyhash_t *hash2, const size_t count, size_t *mismatch);
+extern int jc_rolling_block_hash(enum jc_e_hash type, jodyhash_t *data, jodyhash_t *hash, const size_t count, const size_t block_size);
+extern int jc_get_hash_type(const char * const name);
+extern const char *jc_get_hash_name(const enum jc_e_hash type);
+extern int jc_get_hash_width(const enum jc_e_hash type);
+extern size_t jc_tree_leaf_count(const size_t count);
+extern int jc_tree_hash(jodyhash_t *data, const size_t count, jodyhash_t *leaves, jodyhash_t *root);
+extern int jc_tree_root(const jodyhash_t *leaves, const size_t n, jodyhash_t *root);
+extern jodyhash_t jc_tree_combine(const jodyhash_t left, const jodyhash_t right);
+extern int jc_set_hash_seed(const uint64_t seed);
+extern int jc_set_hash_threads(const int threads);
+extern int jc_set_hash_prefetch(size_t distance, size_t threshold);
+extern int jc_set_hash_kernel(const enum jc_e_hash_kernel kernel);
+extern enum jc_e_hash_kernel jc_get_hash_kernel(void);
+extern const char *jc_get_hash_kernel_name(const enum jc_e_hash_kernel kernel);
+extern int jc_hash_init(struct jc_hash_ctx * const JC_RESTRICT ctx, const enum jc_e_hash type);
+extern int jc_hash_update(struct jc_hash_ctx * const JC_RESTRICT ctx, const void *data, size_t len);
+extern int jc_hash_final(struct jc_hash_ctx * const JC_RESTRICT ctx, jodyhash_t *hash);
+extern int jc_hash_set_block_size(struct jc_hash_ctx * const JC_RESTRICT ctx, const size_t block_size);
+
+#ifndef ON_WINDOWS
+/* How jc_hash_fd()/jc_hash_file() read the file; AUTO picks one based on
+ * the size, and the others fall back to READ where they can't be used.
+ * THREADED reads in a second thread while the calling thread hashes. */
+enum jc_e_hash_io { JC_HASH_IO_AUTO, JC_HASH_IO_READ, JC_HASH_IO_MMAP, JC_HASH_IO_DIRECT, JC_HASH_IO_THREADED };
+extern int jc_hash_fd(const int fd, const enum jc_e_hash type, jodyhash_t *hash, const uint64_t limit, enum jc_e_hash_io io);
+extern int jc_hash_file(const char * const path, const enum jc_e_hash type, jodyhash_t *hash, const uint64_t limit, const enum jc_e_hash_io io);
+/* Hash every file in a batch; uses io_uring on Linux when available */
+extern int jc_hash_batch(struct jc_fileinfo_batch * const JC_RESTRICT batch, const enum jc_e_hash type, jodyhash_t *hashes, const uint64_t limit, unsigned int depth);
+#endif /* ON_WINDOWS */
+
+/* Content-defined chunking: boundaries depend on the data, not offsets,
+ * so inserted or removed bytes don't shift every later chunk. Each chunk
+ * also gets a NORMAL jody_hash. Boundaries change if JC_CDC_VERSION does. */
+#define JC_CDC_VERSION 1
+struct jc_cdc_chunk {
+	uint64_t offset;        /* offset of the chunk in the stream */
+	size_t length;
+	jodyhash_t hash;
+};
+
+struct jc_cdc {
+	size_t min, avg, max;   /* chunk size limits */
+	uint64_t mask_s;        /* boundary mask before avg */
+	uint64_t mask_l;        /* boundary mask after avg */
+	uint64_t gear;          /* rolling gear hash */
+	uint64_t offset;        /* stream offset of the current chunk */
+	size_t len;             /* bytes in the current chunk */
+	struct jc_hash_ctx hash;  /* hash of the current chunk */
+};
+
+extern int jc_cdc_init(struct jc_cdc * const JC_RESTRICT cdc, size_t min, size_t avg, size_t max);
+extern int jc_cdc_update(struct jc_cdc * const JC_RESTRICT cdc, const void *data, const size_t len, size_t *used, struct jc_cdc_chunk * const JC_RESTRICT chunk);
+extern int jc_cdc_final(struct jc_cdc * const JC_RESTRICT cdc, struct jc_cdc_chunk * const JC_RESTRICT chunk);
+
+/* Hash quality statistics: per-bit bias, bucket loads for a table of
+ * 2^bucket_bits buckets, and how many equal hashes hide different data.
+ * The id passed with each hash identifies the data (a size plus another
+ * hash, for example). "make hashstats" builds a tool that uses these. */
+#define JC_HSTAT_BUCKET_BITS 16
+#define JC_HSTAT_LOADS 8
+struct jc_hash_stats_item {
+	jodyhash_t hash;
+	uint64_t id;
+};
+
+struct jc_hash_stats {
+	size_t count;           /* hashes added */
+	size_t alloc;           /* room in items */
+	uint64_t bit_ones[64];  /* times each hash bit was set */
+	uint64_t *buckets;      /* hashes per bucket, indexed by the low bits */
+	unsigned int bucket_bits;
+	struct jc_hash_stats_item *items;
+};
+
+struct jc_hash_stats_summary {
+	uint64_t count;
+	double bit_bias[64];    /* fraction of hashes with the bit set, minus 0.5 */
+	double max_bit_bias;    /* largest absolute bias */
+	unsigned int max_bias_bit;
+	double bucket_expect;   /* mean hashes per bucket */
+	double bucket_chi2;     /* chi-squared against a uniform spread */
+	uint64_t bucket_min, bucket_max;
+	uint64_t bucket_loads[JC_HSTAT_LOADS];  /* buckets with 0, 1, ... hashes; last is "or more" */
+	uint64_t matches;       /* hashes equal to an earlier hash */
+	uint64_t match_groups;  /* distinct hashes seen more than once */
+	uint64_t false_matches; /* matches where the data differed */
+};
+
+extern int jc_hash_stats_init(struct jc_hash_stats * const JC_RESTRICT st, unsigned int bucket_bits);
+extern int jc_hash_stats_add(struct jc_hash_stats * const JC_RESTRICT st, const jodyhash_t hash, const uint64_t id);
+extern int jc_hash_stats_report(struct jc_hash_stats * const JC_RESTRICT st, struct jc_hash_stats_summary * const JC_RESTRICT r);
+extern void jc_hash_stats_free(struct jc_hash_stats * const JC_RESTRICT st);
+
+/* Inline hash for short in-memory keys (hash tables keyed by paths, inode
+ * numbers, etc.); same result as jc_block_hash(NORMAL) with a zero starting
+ * hash. Keys up to 64 bytes are hashed without calls or loops; longer keys
+ * are passed to jc_block_hash(). These constants must match jody_hash.h. */
+#define JC_HS_CONSTANT      0x71812e0f5463d3c8ULL
+#define JC_HS_CONSTANT_ROR2 0x463d3c871812e0f5ULL
+#define JC_HS_MAX           64
+
+static inline jodyhash_t jc_hash_short_load(const unsigned char * const p)
+{
+	jodyhash_t element;
+
+	memcpy(&element, p, sizeof(jodyhash_t));
+	return element;
+}
+
+static inline jodyhash_t jc_hash_short_mix(jodyhash_t hash, const jodyhash_t element, const int tail)
+{
+	const jodyhash_t e1 = element + JC_HS_CONSTANT;
+	const jodyhash_t e2 = ((element >> 14) | (element << 50)) ^ JC_HS_CONSTANT_ROR2;
+
+	hash += e1;
+	hash ^= e2;
+	hash = (hash << 28) | (hash >> 36);
+	return hash + (tail ? e2 : e1);
+}
+
+static inline jodyhash_t jc_hash_short(const void * const data, const size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	const size_t tail = len & (sizeof(jodyhash_t) - 1);
+	jodyhash_t hash = 0;
+	jodyhash_t element;
+
+	if (len > JC_HS_MAX) {
+		jc_block_hash(NORMAL, (jodyhash_t *)(uintptr_t)data, &hash, len);
+		return hash;
+	}
+
+	/* Whole words, indexed back from the end of the last whole word */
+	p += len - tail;
+	switch (len / sizeof(jodyhash_t)) {
+	case 8: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 64), 0); /* fall through */
+	case 7: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 56), 0); /* fall through */
+	case 6: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 48), 0); /* fall through */
+	case 5: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 40), 0); /* fall through */
+	case 4: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 32), 0); /* fall through */
+	case 3: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 24), 0); /* fall through */
+	case 2: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 16), 0); /* fall through */
+	case 1: hash = jc_hash_short_mix(hash, jc_hash_short_load(p - 8), 0); /* fall through */
+	case 0:
+	default: break;
+	}
+
+	if (tail == 0) return hash;
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	/* Keys of a word or more: load the last word and shift the tail down */
+	if (len >= sizeof(jodyhash_t)) {
+		element = jc_hash_short_load(p + tail - sizeof(jodyhash_t)) >> (64 - (tail * 8));
+		return jc_hash_short_mix(hash, element, 1);
+	}
+#endif
+	element = 0;
+	memcpy(&element, p, tail);
+	return jc_hash_short_mix(hash, element, 1);
+}
 
 
 /*** linkfiles ***/
@@ -373,12 +617,18 @@ extern int jc_block_hash(enum jc_e_hash type, jodyhash_t *data, jodyhash_t *hash
 extern int jc_dedupe(struct jc_fileinfo_batch *batch);
 #endif /* __linux__ */
 
+#ifndef ON_WINDOWS
+/* How jc_copy_hash() copied the data: reflink, copy_file_range(), read/write */
+enum jc_e_copy { JC_COPY_CLONE, JC_COPY_RANGE, JC_COPY_RW };
+extern int jc_copy_hash(const int src_fd, const int dest_fd, const enum jc_e_hash type, jodyhash_t *hash, enum jc_e_copy *method);
+#endif /* ON_WINDOWS */
+
 
 /*** oom ***/
 
 /* Out-of-memory and null pointer error-exit functions */
-extern void jc_oom(const char * restrict msg);
-extern void jc_nullptr(const char * restrict func);
+extern void jc_oom(const char * JC_RESTRICT msg);
+extern void jc_nullptr(const char * JC_RESTRICT func);
 
 
 /*** paths ***/
@@ -404,7 +654,7 @@ extern const struct jc_size_suffix jc_size_suffix[];
 
 /* Numerically-correct string sort with a little extra intelligence
    insensitive: 0 = case-sensitive, 1 = case-insensitive */
-extern int jc_numeric_strcmp(const char * restrict c1, const char * restrict c2, const int insensitive);
+extern int jc_numeric_strcmp(const char * JC_RESTRICT c1, const char * JC_RESTRICT c2, const int insensitive);
 
 
 /*** string ***/
@@ -431,6 +681,8 @@ extern const char *jc_verdate;
 extern const int jc_api_version;
 extern const int jc_api_featurelevel;
 extern const int jc_jodyhash_version;
+extern const int jc_jodyhash_striped_version;
+extern const int jc_jodyhash128_version;
 extern const int jc_windows_unicode;
 
 
@@ -454,7 +706,7 @@ extern const int jc_windows_unicode;
 
  /* These are used for Unicode output and string work on Windows only */
  #ifdef UNICODE
-  extern int jc_string_to_wstring(const char * const restrict string, JC_WCHAR_T **wstring);
+  extern int jc_string_to_wstring(const char * const JC_RESTRICT string, JC_WCHAR_T **wstring);
   extern int jc_widearg_to_argv(int argc, JC_WCHAR_T **wargv, char **argv);
  #endif /* UNICODE */
 #else
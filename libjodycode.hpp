@@ -0,0 +1,425 @@
+/* Jody Bruchon's helpful code library C++ header
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Licensed under The MIT License
+ * Source code: https://codeberg.org/jbruchon/libjodycode
+ *
+ * Header-only C++17 wrappers around libjodycode.h. Everything here calls
+ * the same C functions; nothing needs to be compiled into the library.
+ * The std::span overloads need C++20.
+ */
+
+#ifndef LIBJODYCODE_HPP
+#define LIBJODYCODE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 202002L && __has_include(<span>)
+ #include <span>
+ #define JC_HAVE_SPAN 1
+#endif
+
+#include "libjodycode.h"
+
+static_assert(JODY_HASH_WIDTH == 64, "libjodycode.hpp needs 64-bit jody_hash");
+
+namespace jc {
+
+namespace detail {
+/* jc_errno holds either a JC_E* code or a system errno value */
+inline const char *error_desc(const int32_t code)
+{
+	const char *desc = nullptr;
+
+	if (code >= JC_ERRORCODE_START) desc = jc_get_errdesc(code - JC_ERRORCODE_START);
+	else if (code > 0) desc = std::strerror(code);
+	return desc != nullptr ? desc : "unknown libjodycode error";
+}
+} /* namespace detail */
+
+/* Thrown when a C call fails; code() is the jc_errno value */
+class error : public std::runtime_error {
+public:
+	explicit error(const int32_t code) : std::runtime_error(detail::error_desc(code)), m_code(code) {}
+	int32_t code() const noexcept { return m_code; }
+private:
+	int32_t m_code;
+};
+
+[[noreturn]] inline void throw_error() { throw error(jc_errno); }
+
+
+/*** compile-time jody_hash ***/
+
+namespace detail {
+
+constexpr jodyhash_t hash_mix(jodyhash_t hash, const jodyhash_t element, const bool tail)
+{
+	const jodyhash_t e1 = element + JC_HS_CONSTANT;
+	const jodyhash_t e2 = ((element >> 14) | (element << 50)) ^ JC_HS_CONSTANT_ROR2;
+
+	hash += e1;
+	hash ^= e2;
+	hash = (hash << 28) | (hash >> 36);
+	return hash + (tail ? e2 : e1);
+}
+
+/* Native-endian load of up to one word, zero padded like the C tail load */
+constexpr jodyhash_t hash_load(const char * const p, const std::size_t len)
+{
+	jodyhash_t element = 0;
+
+	for (std::size_t i = 0; i < len; i++) {
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		element |= static_cast<jodyhash_t>(static_cast<unsigned char>(p[i])) << (8 * (sizeof(jodyhash_t) - 1 - i));
+#else
+		element |= static_cast<jodyhash_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+#endif
+	}
+	return element;
+}
+
+} /* namespace detail */
+
+/* NORMAL jody_hash of a string with a zero starting hash; same result as
+ * jc_block_hash(NORMAL) and jc_hash_short(), but usable at compile time */
+constexpr jodyhash_t hash(const std::string_view s)
+{
+	const std::size_t words = s.size() / sizeof(jodyhash_t);
+	const std::size_t tail = s.size() % sizeof(jodyhash_t);
+	jodyhash_t h = 0;
+
+	for (std::size_t i = 0; i < words; i++)
+		h = detail::hash_mix(h, detail::hash_load(s.data() + (i * sizeof(jodyhash_t)), sizeof(jodyhash_t)), false);
+	if (tail != 0) h = detail::hash_mix(h, detail::hash_load(s.data() + (words * sizeof(jodyhash_t)), tail), true);
+	return h;
+}
+
+namespace literals {
+/* "key"_jodyhash */
+constexpr jodyhash_t operator""_jodyhash(const char *s, const std::size_t len)
+{
+	return ::jc::hash(std::string_view(s, len));
+}
+} /* namespace literals */
+
+
+/*** block hashing ***/
+
+/* Result type of each hash type; NORMAL128 fills two words and CRC32C
+ * only uses 32 bits */
+template <enum jc_e_hash Type> struct hash_traits {
+	using result_type = jodyhash_t;
+	static constexpr int width = 64;
+};
+template <> struct hash_traits<NORMAL128> {
+	using result_type = std::array<jodyhash_t, 2>;
+	static constexpr int width = 128;
+};
+template <> struct hash_traits<CRC32C> {
+	using result_type = uint32_t;
+	static constexpr int width = 32;
+};
+
+template <enum jc_e_hash Type>
+using hash_result = typename hash_traits<Type>::result_type;
+
+/* One-shot hash of len bytes, chained from seed. NORMAL and ROLLING call
+ * their own entry points; other types still go through jc_block_hash(),
+ * which picks the backend at run time. */
+template <enum jc_e_hash Type>
+inline hash_result<Type> block_hash(const void * const data, const std::size_t len, hash_result<Type> seed = hash_result<Type>{})
+{
+	/* The C API takes non-const data but never writes to it */
+	jodyhash_t * const p = static_cast<jodyhash_t *>(const_cast<void *>(data));
+
+	if constexpr (Type == NORMAL128) {
+		if (jc_block_hash(Type, p, seed.data(), len) != 0) throw_error();
+		return seed;
+	} else if constexpr (Type == NORMAL) {
+		if (jc_block_hash_normal(p, &seed, len) != 0) throw_error();
+		return seed;
+	} else if constexpr (Type == ROLLING) {
+		if (jc_block_hash_rolling(p, &seed, len) != 0) throw_error();
+		return seed;
+	} else {
+		jodyhash_t h = seed;
+		if (jc_block_hash(Type, p, &h, len) != 0) throw_error();
+		return static_cast<hash_result<Type>>(h);
+	}
+}
+
+/* ROLLING with a compile-time block size. Default size ROLLING calls its
+ * own entry point; ROLLING_MT and other sizes are checked at run time. */
+template <std::size_t BlockSize = 4096, enum jc_e_hash Type = ROLLING>
+inline jodyhash_t rolling_hash(const void * const data, const std::size_t len, jodyhash_t seed = 0)
+{
+	static_assert(Type == ROLLING || Type == ROLLING_MT, "rolling_hash needs ROLLING or ROLLING_MT");
+	static_assert(BlockSize >= sizeof(jodyhash_t) && (BlockSize & (BlockSize - 1)) == 0, "block size must be a power of two");
+	jodyhash_t * const p = static_cast<jodyhash_t *>(const_cast<void *>(data));
+
+	if constexpr (BlockSize == 4096 && Type == ROLLING) {
+		if (jc_block_hash_rolling(p, &seed, len) != 0) throw_error();
+	} else if constexpr (BlockSize == 4096) {
+		if (jc_block_hash(Type, p, &seed, len) != 0) throw_error();
+	} else {
+		if (jc_rolling_block_hash(Type, p, &seed, len, BlockSize) != 0) throw_error();
+	}
+	return seed;
+}
+
+#ifdef JC_HAVE_SPAN
+template <enum jc_e_hash Type, typename T, std::size_t Extent>
+inline hash_result<Type> block_hash(const std::span<T, Extent> data, hash_result<Type> seed = hash_result<Type>{})
+{
+	return block_hash<Type>(data.data(), data.size_bytes(), seed);
+}
+
+template <std::size_t BlockSize = 4096, enum jc_e_hash Type = ROLLING, typename T, std::size_t Extent>
+inline jodyhash_t rolling_hash(const std::span<T, Extent> data, jodyhash_t seed = 0)
+{
+	return rolling_hash<BlockSize, Type>(data.data(), data.size_bytes(), seed);
+}
+#endif /* JC_HAVE_SPAN */
+
+#ifndef ON_WINDOWS
+/* Hash a file, or its first limit bytes; see jc_hash_file() */
+template <enum jc_e_hash Type>
+inline hash_result<Type> hash_file(const char * const path, const uint64_t limit = 0, const enum jc_e_hash_io io = JC_HASH_IO_AUTO)
+{
+	std::array<jodyhash_t, 2> h{};
+
+	if (jc_hash_file(path, Type, h.data(), limit, io) != 0) throw_error();
+	if constexpr (Type == NORMAL128) return h;
+	else return static_cast<hash_result<Type>>(h[0]);
+}
+#endif /* ON_WINDOWS */
+
+
+/* Streaming hash (jc_hash_init/update/final); STRIPED is not supported */
+template <enum jc_e_hash Type>
+class hasher {
+public:
+	static_assert(Type != STRIPED, "STRIPED can't be streamed");
+
+	hasher() { if (jc_hash_init(&m_ctx, Type) != 0) throw_error(); }
+	explicit hasher(const std::size_t block_size) : hasher()
+	{
+		if (jc_hash_set_block_size(&m_ctx, block_size) != 0) throw_error();
+	}
+
+	hasher &update(const void * const data, const std::size_t len)
+	{
+		if (jc_hash_update(&m_ctx, data, len) != 0) throw_error();
+		return *this;
+	}
+#ifdef JC_HAVE_SPAN
+	template <typename T, std::size_t Extent>
+	hasher &update(const std::span<T, Extent> data) { return update(data.data(), data.size_bytes()); }
+#endif
+
+	/* The hasher must be reset() before it can be used again */
+	hash_result<Type> final()
+	{
+		std::array<jodyhash_t, 2> h{};
+		if (jc_hash_final(&m_ctx, h.data()) != 0) throw_error();
+		if constexpr (Type == NORMAL128) return h;
+		else return static_cast<hash_result<Type>>(h[0]);
+	}
+
+	void reset() { if (jc_hash_init(&m_ctx, Type) != 0) throw_error(); }
+
+	struct jc_hash_ctx *get() noexcept { return &m_ctx; }
+
+private:
+	struct jc_hash_ctx m_ctx;
+};
+
+
+/*** RAII handles ***/
+
+/* Owns a jc_fileinfo_batch; move-only */
+class fileinfo_batch {
+public:
+	fileinfo_batch() noexcept = default;
+	fileinfo_batch(const int filecnt, const bool stat, const int namlen)
+	{
+		if (filecnt <= 0) throw error(EINVAL);
+		m_batch = jc_fileinfo_batch_alloc(filecnt, stat ? 1 : 0, namlen);
+		if (m_batch == nullptr) throw std::bad_alloc();
+	}
+	explicit fileinfo_batch(struct jc_fileinfo_batch * const batch) noexcept : m_batch(batch) {}
+	~fileinfo_batch() { if (m_batch != nullptr) jc_fileinfo_batch_free(m_batch); }
+
+	fileinfo_batch(const fileinfo_batch &) = delete;
+	fileinfo_batch &operator=(const fileinfo_batch &) = delete;
+	fileinfo_batch(fileinfo_batch &&other) noexcept : m_batch(std::exchange(other.m_batch, nullptr)) {}
+	fileinfo_batch &operator=(fileinfo_batch &&other) noexcept
+	{
+		if (this != &other) {
+			if (m_batch != nullptr) jc_fileinfo_batch_free(m_batch);
+			m_batch = std::exchange(other.m_batch, nullptr);
+		}
+		return *this;
+	}
+
+	struct jc_fileinfo_batch *get() const noexcept { return m_batch; }
+	struct jc_fileinfo_batch *release() noexcept { return std::exchange(m_batch, nullptr); }
+	struct jc_fileinfo_batch *operator->() const noexcept { return m_batch; }
+	explicit operator bool() const noexcept { return m_batch != nullptr; }
+
+	int size() const noexcept { return m_batch != nullptr ? m_batch->count : 0; }
+	struct jc_fileinfo *begin() const noexcept { return m_batch != nullptr ? m_batch->files : nullptr; }
+	struct jc_fileinfo *end() const noexcept { return m_batch != nullptr ? m_batch->files + m_batch->count : nullptr; }
+	struct jc_fileinfo &operator[](const int i) const noexcept { return m_batch->files[i]; }
+
+private:
+	struct jc_fileinfo_batch *m_batch = nullptr;
+};
+
+
+/* Owns an open directory; move-only. Iterating gives each JC_DIRENT. */
+class dir {
+public:
+	class iterator {
+	public:
+		using value_type = JC_DIRENT;
+		using reference = JC_DIRENT &;
+		using pointer = JC_DIRENT *;
+		using difference_type = std::ptrdiff_t;
+		using iterator_category = std::input_iterator_tag;
+
+		iterator() noexcept = default;
+		explicit iterator(JC_DIR * const d) : m_dir(d), m_ent(jc_readdir(d)) {}
+		reference operator*() const noexcept { return *m_ent; }
+		pointer operator->() const noexcept { return m_ent; }
+		iterator &operator++() { m_ent = jc_readdir(m_dir); return *this; }
+		bool operator==(const iterator &other) const noexcept { return m_ent == other.m_ent; }
+		bool operator!=(const iterator &other) const noexcept { return m_ent != other.m_ent; }
+	private:
+		JC_DIR *m_dir = nullptr;
+		JC_DIRENT *m_ent = nullptr;
+	};
+
+	dir() noexcept = default;
+	explicit dir(const char * const path) : m_dir(jc_opendir(path))
+	{
+		if (m_dir == nullptr) throw_error();
+	}
+	~dir() { if (m_dir != nullptr) jc_closedir(m_dir); }
+
+	dir(const dir &) = delete;
+	dir &operator=(const dir &) = delete;
+	dir(dir &&other) noexcept : m_dir(std::exchange(other.m_dir, nullptr)) {}
+	dir &operator=(dir &&other) noexcept
+	{
+		if (this != &other) {
+			if (m_dir != nullptr) jc_closedir(m_dir);
+			m_dir = std::exchange(other.m_dir, nullptr);
+		}
+		return *this;
+	}
+
+	/* nullptr at the end of the directory */
+	JC_DIRENT *read() noexcept { return jc_readdir(m_dir); }
+	iterator begin() { return iterator(m_dir); }
+	iterator end() noexcept { return iterator(); }
+
+	JC_DIR *get() const noexcept { return m_dir; }
+	explicit operator bool() const noexcept { return m_dir != nullptr; }
+
+private:
+	JC_DIR *m_dir = nullptr;
+};
+
+
+/* Owns jc_hash_stats storage; move-only */
+class hash_stats {
+public:
+	explicit hash_stats(const unsigned int bucket_bits = 0)
+	{
+		if (jc_hash_stats_init(&m_st, bucket_bits) != 0) throw_error();
+	}
+	~hash_stats() { jc_hash_stats_free(&m_st); }
+
+	hash_stats(const hash_stats &) = delete;
+	hash_stats &operator=(const hash_stats &) = delete;
+	hash_stats(hash_stats &&other) noexcept : m_st(other.m_st) { other.m_st = {}; }
+	hash_stats &operator=(hash_stats &&other) noexcept
+	{
+		if (this != &other) {
+			jc_hash_stats_free(&m_st);
+			m_st = other.m_st;
+			other.m_st = {};
+		}
+		return *this;
+	}
+
+	void add(const jodyhash_t hash, const uint64_t id)
+	{
+		if (jc_hash_stats_add(&m_st, hash, id) != 0) throw_error();
+	}
+	struct jc_hash_stats_summary report()
+	{
+		struct jc_hash_stats_summary r;
+		if (jc_hash_stats_report(&m_st, &r) != 0) throw_error();
+		return r;
+	}
+
+	struct jc_hash_stats *get() noexcept { return &m_st; }
+
+private:
+	struct jc_hash_stats m_st;
+};
+
+
+/* Leases an aligned buffer from the calling thread's pool; move-only.
+ * Give it back on the thread that will reuse it. */
+class pool_buffer {
+public:
+	pool_buffer() noexcept = default;
+	explicit pool_buffer(const size_t size) : m_size(size)
+	{
+		m_buf = jc_pool_get(size);
+		if (m_buf == nullptr) {
+			if (size == 0) throw error(EINVAL);
+			throw std::bad_alloc();
+		}
+	}
+	~pool_buffer() { jc_pool_put(m_buf, m_size); }
+
+	pool_buffer(const pool_buffer &) = delete;
+	pool_buffer &operator=(const pool_buffer &) = delete;
+	pool_buffer(pool_buffer &&other) noexcept
+		: m_buf(std::exchange(other.m_buf, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+	pool_buffer &operator=(pool_buffer &&other) noexcept
+	{
+		if (this != &other) {
+			jc_pool_put(m_buf, m_size);
+			m_buf = std::exchange(other.m_buf, nullptr);
+			m_size = std::exchange(other.m_size, 0);
+		}
+		return *this;
+	}
+
+	void *get() const noexcept { return m_buf; }
+	unsigned char *data() const noexcept { return static_cast<unsigned char *>(m_buf); }
+	size_t size() const noexcept { return m_size; }
+	explicit operator bool() const noexcept { return m_buf != nullptr; }
+
+private:
+	void *m_buf = nullptr;
+	size_t m_size = 0;
+};
+
+} /* namespace jc */
+
+#endif /* LIBJODYCODE_HPP */
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "libjodycode.h"
 #include "likely_unlikely.h"
@@ -27,8 +28,14 @@
   #define FICLONE _IOW(0x94, 9, int)
  #endif
  #include <sys/ioctl.h>
+ #include <sys/syscall.h>
 #endif /* __linux__ */
 
+/* Copy/hash buffer size for jc_copy_hash() */
+#ifndef JC_COPY_BUFSIZE
+ #define JC_COPY_BUFSIZE 1048576
+#endif
+
 
 #ifdef __linux__
 extern int jc_dedupe(struct jc_fileinfo_batch * const restrict batch)
@@ -76,6 +83,123 @@ error_with_errno:
 }
 #endif /* __linux__ */
 
+
+#ifndef ON_WINDOWS
+/* Hash len bytes of src_fd at off that are already in dest_fd */
+static int copy_hash_range(const int src_fd, off_t off, size_t len, struct jc_hash_ctx * const restrict ctx, jodyhash_t *buf)
+{
+	ssize_t got;
+
+	while (len > 0) {
+		got = pread(src_fd, buf, len > JC_COPY_BUFSIZE ? JC_COPY_BUFSIZE : len, off);
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0) return -1;
+		/* The source shrank or can't be hashed */
+		if (got == 0 || jc_hash_update(ctx, buf, (size_t)got) != 0) {
+			errno = EIO;
+			return -1;
+		}
+		off += got;
+		len -= (size_t)got;
+	}
+	return 0;
+}
+
+
+/* Copy all of src_fd into dest_fd (which should be empty) and hash the
+ * data on the way. A reflink (FICLONE) is tried first, then
+ * copy_file_range(), then plain reads and writes. A reflink only shares
+ * extents and never reads the data, so hashing it means reading the
+ * whole source afterwards, from disk unless it is already cached; the
+ * copy itself stays nearly free. copy_file_range() data is hashed from
+ * the source right after each chunk is copied, and the read/write loop
+ * hashes its buffer before writing it. hash may be NULL to only copy;
+ * NORMAL128 needs room for two jodyhash_t. *method says how the data was
+ * copied and may also be NULL. */
+extern int jc_copy_hash(const int src_fd, const int dest_fd, const enum jc_e_hash type, jodyhash_t *hash, enum jc_e_copy *method)
+{
+	struct jc_hash_ctx ctx;
+	struct stat st;
+	jodyhash_t *buf = NULL;
+	enum jc_e_copy how = JC_COPY_RW;
+	off_t off = 0;
+	ssize_t got, put;
+
+	if (unlikely(src_fd < 0 || dest_fd < 0)) {
+		jc_errno = EBADF;
+		return -1;
+	}
+	if (hash != NULL && jc_hash_init(&ctx, type) != 0) return -1;
+	if (fstat(src_fd, &st) != 0) goto error_with_errno;
+	/* Kernel copies only need a buffer to hash the data */
+	if (hash != NULL) {
+		buf = (jodyhash_t *)jc_pool_get(JC_COPY_BUFSIZE);
+		if (buf == NULL) return -1;
+	}
+
+#ifdef __linux__
+	/* Reflink: no data is copied at all */
+	if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+		how = JC_COPY_CLONE;
+		if (hash != NULL && copy_hash_range(src_fd, 0, (size_t)st.st_size, &ctx, buf) != 0) goto error_with_errno;
+		goto done;
+	}
+
+ #ifdef __NR_copy_file_range
+	/* In-kernel copy; unsupported file systems fail on the first call */
+	for (;;) {
+		loff_t off_in = off, off_out = off;
+
+		got = (ssize_t)syscall(__NR_copy_file_range, src_fd, &off_in, dest_fd, &off_out, (size_t)JC_COPY_BUFSIZE, 0U);
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0 && off == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) break;
+		if (got < 0) goto error_with_errno;
+		/* Some sources (procfs, some cross-fs copies) return 0 before
+		 * the end; only trust it once st_size bytes are copied */
+		if (got == 0 && off > 0 && off >= st.st_size) {
+			how = JC_COPY_RANGE;
+			goto done;
+		}
+		if (got == 0) break;
+		if (hash != NULL && copy_hash_range(src_fd, off, (size_t)got, &ctx, buf) != 0) goto error_with_errno;
+		off += got;
+	}
+ #endif /* __NR_copy_file_range */
+#endif /* __linux__ */
+
+	/* Plain read/write loop */
+	if (buf == NULL) {
+		buf = (jodyhash_t *)jc_pool_get(JC_COPY_BUFSIZE);
+		if (buf == NULL) return -1;
+	}
+	for (;;) {
+		got = pread(src_fd, buf, JC_COPY_BUFSIZE, off);
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0) goto error_with_errno;
+		if (got == 0) break;
+		if (hash != NULL && jc_hash_update(&ctx, buf, (size_t)got) != 0) goto error;
+		for (ssize_t done = 0; done < got; done += put) {
+			put = pwrite(dest_fd, (char *)buf + done, (size_t)(got - done), off + done);
+			if (put < 0 && errno == EINTR) put = 0;
+			else if (put <= 0) goto error_with_errno;
+		}
+		off += got;
+	}
+
+done:
+	jc_pool_put(buf, JC_COPY_BUFSIZE);
+	if (hash != NULL && jc_hash_final(&ctx, hash) != 0) return -1;
+	if (method != NULL) *method = how;
+	return 0;
+
+error_with_errno:
+	jc_errno = errno;
+error:
+	jc_pool_put(buf, JC_COPY_BUFSIZE);
+	return -1;
+}
+#endif /* ON_WINDOWS */
+
 #if 0
 /* linktype: 0=symlink, 1=hardlink, 2=clonefile() */
 extern int jc_linkfiles(struct jc_fileinfo_batch *batch, const int linktype)
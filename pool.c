@@ -0,0 +1,277 @@
+/* libjodycode: per-thread aligned buffer pool
+ *
+ * Scanning millions of files with a fresh read buffer for each one churns
+ * the allocator and faults in new pages every time. jc_pool_get() leases
+ * a buffer from the calling thread's pool and jc_pool_put() gives it back
+ * for reuse. Buffers are JC_POOL_ALIGN aligned, which suits both the SIMD
+ * kernels and O_DIRECT, and sizes are rounded up to a power of two so
+ * similar requests share buffers. Buffers of JC_POOL_HUGE bytes or more
+ * are 2 MiB aligned mappings marked MADV_HUGEPAGE on Linux to cut TLB
+ * misses.
+ *
+ * Copyright (C) 2024 by Jody Bruchon <jody@jodybruchon.com>
+ * Released under The MIT License
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libjodycode.h"
+#include "likely_unlikely.h"
+
+#if defined _WIN32 || defined __WIN32 || defined ON_WINDOWS
+ #ifndef NO_THREADS
+  #define NO_THREADS
+ #endif
+ #include <malloc.h>
+#endif
+
+#ifndef NO_THREADS
+ #include <pthread.h>
+#endif
+#ifdef __linux__
+ #include <sys/mman.h>
+#endif
+
+/* Smallest buffer (as a power of two) and the largest one that is pooled;
+ * bigger buffers are allocated and freed on every use */
+#define JC_POOL_MIN_SHIFT 12
+#define JC_POOL_MAX_SHIFT 26
+#define JC_POOL_CLASSES (JC_POOL_MAX_SHIFT - JC_POOL_MIN_SHIFT + 1)
+/* Most memory each thread keeps for reuse. The library's own file
+ * hashing and copying lease from the pool, so this stays small: enough
+ * for the per-file read buffers, not for every large buffer ever used. */
+#ifndef JC_POOL_MAX_CACHED
+ #define JC_POOL_MAX_CACHED 4194304
+#endif
+
+struct jc_pool {
+	void *free[JC_POOL_CLASSES];   /* free lists linked through the buffers */
+	struct jc_pool_stats stats;
+};
+
+#ifdef NO_THREADS
+static struct jc_pool pool_single;
+#else
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_key_ok = 0;
+#endif
+
+
+/* Buffer size actually allocated for a request */
+static size_t pool_round(const size_t size)
+{
+	size_t bytes = (size_t)1 << JC_POOL_MIN_SHIFT;
+
+	/* Unpooled buffers are whole huge pages */
+	if (size > ((size_t)1 << JC_POOL_MAX_SHIFT)) return (size + JC_POOL_HUGE - 1) & ~((size_t)JC_POOL_HUGE - 1);
+	while (bytes < size) bytes <<= 1;
+	return bytes;
+}
+
+
+static int pool_class(const size_t bytes)
+{
+	int c = 0;
+
+	if (bytes > ((size_t)1 << JC_POOL_MAX_SHIFT)) return -1;
+	while (((size_t)1 << (c + JC_POOL_MIN_SHIFT)) < bytes) c++;
+	return c;
+}
+
+
+static void *raw_alloc(const size_t bytes)
+{
+	void *buf;
+#ifdef __linux__
+	uintptr_t start, aligned;
+	void *map;
+
+	/* Over-map by 2 MiB and trim so the region can use huge pages */
+	if (bytes >= JC_POOL_HUGE) {
+		map = mmap(NULL, bytes + JC_POOL_HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED) return NULL;
+		start = (uintptr_t)map;
+		aligned = (start + JC_POOL_HUGE - 1) & ~((uintptr_t)JC_POOL_HUGE - 1);
+		if (aligned > start) munmap(map, aligned - start);
+		munmap((void *)(aligned + bytes), JC_POOL_HUGE - (aligned - start));
+		buf = (void *)aligned;
+ #ifdef MADV_HUGEPAGE
+		madvise(buf, bytes, MADV_HUGEPAGE);
+ #endif
+		return buf;
+	}
+#endif /* __linux__ */
+#ifdef ON_WINDOWS
+	buf = _aligned_malloc(bytes, JC_POOL_ALIGN);
+#else
+	if (posix_memalign(&buf, JC_POOL_ALIGN, bytes) != 0) buf = NULL;
+#endif
+	return buf;
+}
+
+
+static void raw_free(void *buf, const size_t bytes)
+{
+#ifdef __linux__
+	if (bytes >= JC_POOL_HUGE) {
+		munmap(buf, bytes);
+		return;
+	}
+#else
+	(void)bytes;
+#endif
+#ifdef ON_WINDOWS
+	_aligned_free(buf);
+#else
+	free(buf);
+#endif
+	return;
+}
+
+
+static void pool_release(struct jc_pool * const restrict pool)
+{
+	void *buf;
+
+	for (int c = 0; c < JC_POOL_CLASSES; c++) {
+		while (pool->free[c] != NULL) {
+			buf = pool->free[c];
+			memcpy(&(pool->free[c]), buf, sizeof(void *));
+			raw_free(buf, (size_t)1 << (c + JC_POOL_MIN_SHIFT));
+		}
+	}
+	pool->stats.cached = 0;
+	return;
+}
+
+
+#ifndef NO_THREADS
+static void pool_destroy(void *arg)
+{
+	pool_release((struct jc_pool *)arg);
+	free(arg);
+	return;
+}
+
+
+static void pool_key_init(void)
+{
+	if (pthread_key_create(&pool_key, pool_destroy) == 0) pool_key_ok = 1;
+	return;
+}
+#endif /* NO_THREADS */
+
+
+/* The calling thread's pool, or NULL if it can't be set up */
+static struct jc_pool *pool_get_pool(void)
+{
+#ifdef NO_THREADS
+	return &pool_single;
+#else
+	struct jc_pool *pool;
+
+	pthread_once(&pool_once, pool_key_init);
+	if (unlikely(pool_key_ok == 0)) return NULL;
+	pool = (struct jc_pool *)pthread_getspecific(pool_key);
+	if (likely(pool != NULL)) return pool;
+	pool = (struct jc_pool *)calloc(1, sizeof(struct jc_pool));
+	if (pool == NULL) return NULL;
+	if (pthread_setspecific(pool_key, pool) != 0) {
+		free(pool);
+		return NULL;
+	}
+	return pool;
+#endif /* NO_THREADS */
+}
+
+
+/* Lease a buffer of at least size bytes; give it back with jc_pool_put()
+ * and the same size. Contents are not cleared. */
+extern void *jc_pool_get(const size_t size)
+{
+	struct jc_pool *pool = pool_get_pool();
+	const size_t bytes = pool_round(size);
+	const int c = pool_class(bytes);
+	void *buf = NULL;
+
+	if (unlikely(size == 0 || size > SIZE_MAX - JC_POOL_HUGE)) {
+		jc_errno = EINVAL;
+		return NULL;
+	}
+	if (pool != NULL && c >= 0 && pool->free[c] != NULL) {
+		buf = pool->free[c];
+		memcpy(&(pool->free[c]), buf, sizeof(void *));
+		pool->stats.cached -= bytes;
+		pool->stats.hits++;
+	} else {
+		buf = raw_alloc(bytes);
+		if (buf == NULL) {
+			jc_errno = ENOMEM;
+			return NULL;
+		}
+	}
+	if (pool != NULL) {
+		pool->stats.gets++;
+		pool->stats.leased += bytes;
+		if (pool->stats.leased > pool->stats.leased_max) pool->stats.leased_max = pool->stats.leased;
+	}
+	return buf;
+}
+
+
+/* Return a leased buffer; it may come from another thread's pool */
+extern void jc_pool_put(void *buf, const size_t size)
+{
+	struct jc_pool *pool;
+	size_t bytes;
+	int c;
+
+	if (buf == NULL) return;
+	pool = pool_get_pool();
+	bytes = pool_round(size);
+	c = pool_class(bytes);
+	if (pool != NULL) {
+		pool->stats.leased = pool->stats.leased > bytes ? pool->stats.leased - bytes : 0;
+		if (c >= 0 && pool->stats.cached + bytes <= JC_POOL_MAX_CACHED) {
+			memcpy(buf, &(pool->free[c]), sizeof(void *));
+			pool->free[c] = buf;
+			pool->stats.cached += bytes;
+			if (pool->stats.cached > pool->stats.cached_max) pool->stats.cached_max = pool->stats.cached;
+			return;
+		}
+	}
+	raw_free(buf, bytes);
+	return;
+}
+
+
+/* Free every buffer the calling thread's pool is keeping for reuse */
+extern void jc_pool_trim(void)
+{
+	struct jc_pool *pool = pool_get_pool();
+
+	if (pool != NULL) pool_release(pool);
+	return;
+}
+
+
+/* Statistics for the calling thread's pool */
+extern int jc_pool_get_stats(struct jc_pool_stats * const restrict stats)
+{
+	struct jc_pool *pool;
+
+	if (unlikely(stats == NULL)) {
+		jc_errno = JC_ENULL;
+		return -1;
+	}
+	pool = pool_get_pool();
+	if (pool == NULL) {
+		jc_errno = ENOMEM;
+		return -1;
+	}
+	memcpy(stats, &(pool->stats), sizeof(struct jc_pool_stats));
+	return 0;
+}
@@ -0,0 +1,62 @@
+/* Check every SIMD kernel against the scalar jody_hash code at the
+ * JODY_HASH_WIDTH this is built with; "make widthtest" builds and runs
+ * it for widths 64, 32 and 16 */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../jody_hash.h"
+
+#define BUFSIZE 20000
+#define ROUNDS 2000
+
+int main(void)
+{
+	static jodyhash_t buf[(BUFSIZE / sizeof(jodyhash_t)) + 2];
+	unsigned char *data;
+	jodyhash_t ref, ref_roll, hash, roll;
+	size_t len, off;
+	int kernel, bad = 0;
+	unsigned int seed = 1;
+
+	if (sizeof(jodyhash_t) * 8 != JODY_HASH_WIDTH) {
+		printf("width %d: jodyhash_t is %d bits\n", JODY_HASH_WIDTH, (int)(sizeof(jodyhash_t) * 8));
+		return -1;
+	}
+	for (size_t i = 0; i < sizeof(buf); i++) ((unsigned char *)buf)[i] = (unsigned char)rand_r(&seed);
+
+	for (int round = 0; round < ROUNDS; round++) {
+		off = (size_t)rand_r(&seed) % sizeof(jodyhash_t);
+		len = (size_t)rand_r(&seed) % (BUFSIZE - sizeof(jodyhash_t));
+		if (round < 64) len = (size_t)round;
+		data = (unsigned char *)buf + off;
+
+		jody_hash_set_kernel(JH_KERNEL_SCALAR);
+		ref = (jodyhash_t)round;
+		ref_roll = 0;
+		if (jody_block_hash((jodyhash_t *)(uintptr_t)data, &ref, len) != 0
+				|| jody_rolling_block_hash((jodyhash_t *)(uintptr_t)data, &ref_roll, len) != 0) {
+			printf("width %d: scalar hash failed\n", JODY_HASH_WIDTH);
+			return -1;
+		}
+
+		for (kernel = JH_KERNEL_SCALAR + 1; kernel < JH_KERNEL_COUNT; kernel++) {
+			if (jody_hash_set_kernel(kernel) != 0) continue;
+			hash = (jodyhash_t)round;
+			roll = 0;
+			if (jody_block_hash((jodyhash_t *)(uintptr_t)data, &hash, len) != 0
+					|| jody_rolling_block_hash((jodyhash_t *)(uintptr_t)data, &roll, len) != 0
+					|| hash != ref || roll != ref_roll) {
+				if (bad++ < 10) printf("width %d: %s differs from scalar (len %zu, offset %zu)\n",
+						JODY_HASH_WIDTH, jody_hash_kernel_name(kernel), len, off);
+			}
+		}
+	}
+
+	printf("width %d:", JODY_HASH_WIDTH);
+	for (kernel = JH_KERNEL_SCALAR; kernel < JH_KERNEL_COUNT; kernel++)
+		if (jody_hash_set_kernel(kernel) == 0) printf(" %s", jody_hash_kernel_name(kernel));
+	printf(bad == 0 ? " ok\n" : " FAILED\n");
+	return bad == 0 ? 0 : -1;
+}
@@ -11,4 +11,6 @@ const char *jc_verdate = LIBJODYCODE_VERDATE;
 const int jc_api_version = LIBJODYCODE_API_VERSION;
 const int jc_api_featurelevel = LIBJODYCODE_API_FEATURE_LEVEL;
 const int jc_jodyhash_version = JODY_HASH_VERSION;
+const int jc_jodyhash_striped_version = JODY_HASH_STRIPED_VERSION;
+const int jc_jodyhash128_version = JODY_HASH128_VERSION;
 const int jc_windows_unicode = LIBJODYCODE_WINDOWS_UNICODE;